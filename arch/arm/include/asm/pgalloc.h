@@ -11,6 +11,7 @@
 #define _ASMARM_PGALLOC_H
 
 #include <linux/pagemap.h>
+#include <linux/prezero.h>
 
 #include <asm/domain.h>
 #include <asm/pgtable-hwdef.h>
@@ -97,10 +98,13 @@ pte_alloc_one(struct mm_struct *mm, unsigned long addr)
 {
 	struct page *pte;
 
+	pte = prezero_page_get(PREZERO_KERNEL);
 #ifdef CONFIG_HIGHPTE
-	pte = alloc_pages(PGALLOC_GFP | __GFP_HIGHMEM, 0);
+	if (!pte)
+		pte = alloc_pages(PGALLOC_GFP | __GFP_HIGHMEM, 0);
 #else
-	pte = alloc_pages(PGALLOC_GFP, 0);
+	if (!pte)
+		pte = alloc_pages(PGALLOC_GFP, 0);
 #endif
 	if (pte) {
 		if (!PageHighMem(pte))
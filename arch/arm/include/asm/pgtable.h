@@ -228,6 +228,28 @@ static inline void set_pte_at(struct mm_struct *mm, unsigned long addr,
 	set_pte_ext(ptep, pteval, ext);
 }
 
+#ifdef CONFIG_ARM_LPAE
+/*
+ * A huge pmd has the same attribute bits as a pte, so it is written the
+ * same way, write protected in hardware while clean.  Every entry below
+ * TASK_SIZE is made non-global, including those without PMD_SECT_USER
+ * (PROT_NONE): a global entry would survive the switch to another mm.
+ */
+static inline void set_pmd_at(struct mm_struct *mm, unsigned long addr,
+			      pmd_t *pmdp, pmd_t pmd)
+{
+	unsigned long ext = 0;
+
+	if (addr < TASK_SIZE && pmd_val(pmd)) {
+		if (pmd_val(pmd) & PMD_SECT_USER)
+			__sync_icache_dcache(__pte(pmd_val(pmd)));
+		ext |= PMD_SECT_nG;
+	}
+
+	set_pte_ext((pte_t *)pmdp, __pte(pmd_val(pmd)), ext);
+}
+#endif
+
 #define PTE_BIT_FUNC(fn,op) \
 static inline pte_t pte_##fn(pte_t pte) { pte_val(pte) op; return pte; }
 
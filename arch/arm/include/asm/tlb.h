@@ -153,6 +153,17 @@ tlb_remove_tlb_entry(struct mmu_gather *tlb, pte_t *ptep, unsigned long addr)
 	tlb_add_flush(tlb, addr);
 }
 
+/*
+ * Invalidating any address within a section invalidates the whole
+ * section mapping, so a huge pmd needs no more than a pte.
+ */
+static inline void
+tlb_remove_pmd_tlb_entry(struct mmu_gather *tlb, pmd_t *pmdp,
+			 unsigned long addr)
+{
+	tlb_add_flush(tlb, addr);
+}
+
 /*
  * In the case of tlb vma handling, we can optimise these away in the
  * case where we're doing a full MM flush.  When we're doing a munmap,
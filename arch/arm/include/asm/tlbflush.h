@@ -505,6 +505,9 @@ static inline void update_mmu_cache(struct vm_area_struct *vma,
 }
 #endif
 
+/* huge pmds are only supported with LPAE, where set_pmd_at() does this */
+#define update_mmu_cache_pmd(vma, address, pmd) do { } while (0)
+
 #endif
 
 #endif /* CONFIG_MMU */
@@ -64,7 +64,8 @@ struct cpu_efficiency {
  *   0 < cpu_scale < 3*SCHED_POWER_SCALE/2
  * in order to return at most 1 when DIV_ROUND_CLOSEST
  * is used to compute the capacity of a CPU.
- * Processors that are not defined in the table,
+ * Processors that are not defined in the table, and have no
+ * "capacity-dmips-mhz" property in DT to give their efficiency,
  * use the default SCHED_POWER_SCALE value for cpu_scale.
  */
 struct cpu_efficiency table_efficiency[] = {
@@ -84,7 +85,8 @@ unsigned long middle_capacity = 1;
 
 /*
  * Iterate all CPUs' descriptor in DT and compute the efficiency
- * (as per table_efficiency). Also calculate a middle efficiency
+ * (as per their capacity-dmips-mhz property, or else table_efficiency).
+ * Also calculate a middle efficiency
  * as close as possible to  (max{eff_i} - min{eff_i}) / 2
  * This is later used to scale the cpu_power field such that an
  * 'average' CPU is of middle power. Also see the comments near
@@ -103,18 +105,33 @@ static void __init parse_dt_topology(void)
 	cpu_capacity = (struct cpu_capacity *)kzalloc(alloc_size, GFP_NOWAIT);
 
 	while ((cn = of_find_node_by_type(cn, "cpu"))) {
-		const u32 *rate, *reg;
+		const u32 *rate, *reg, *dmips;
+		unsigned long efficiency;
 		int len;
 
 		if (cpu >= num_possible_cpus())
 			break;
 
-		for (cpu_eff = table_efficiency; cpu_eff->compatible; cpu_eff++)
-			if (of_device_is_compatible(cn, cpu_eff->compatible))
-				break;
+		dmips = of_get_property(cn, "capacity-dmips-mhz", &len);
+		if (dmips && len == 4) {
+			efficiency = be32_to_cpup(dmips);
+			if (!efficiency || efficiency >= (1 << 20)) {
+				pr_err("%s invalid capacity-dmips-mhz property\n",
+					cn->full_name);
+				continue;
+			}
+		} else {
+			for (cpu_eff = table_efficiency; cpu_eff->compatible;
+			     cpu_eff++)
+				if (of_device_is_compatible(cn,
+							    cpu_eff->compatible))
+					break;
 
-		if (cpu_eff->compatible == NULL)
-			continue;
+			if (cpu_eff->compatible == NULL)
+				continue;
+
+			efficiency = cpu_eff->efficiency;
+		}
 
 		rate = of_get_property(cn, "clock-frequency", &len);
 		if (!rate || len != 4) {
@@ -129,7 +146,7 @@ static void __init parse_dt_topology(void)
 			continue;
 		}
 
-		capacity = ((be32_to_cpup(rate)) >> 20) * cpu_eff->efficiency;
+		capacity = ((be32_to_cpup(rate)) >> 20) * efficiency;
 
 		/* Save min capacity of the system */
 		if (capacity < min_capacity)
@@ -341,3 +358,29 @@ void __init init_cpu_topology(void)
 
 	parse_dt_topology();
 }
+
+/*
+ * Export the power of each cpu, so that userspace can tell the big cpus
+ * from the small ones.
+ */
+static ssize_t show_cpu_capacity(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", arch_scale_freq_power(NULL, dev->id));
+}
+
+static DEVICE_ATTR(cpu_capacity, 0444, show_cpu_capacity, NULL);
+
+static int __init register_cpu_capacity(void)
+{
+	struct device *dev;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		dev = get_cpu_device(cpu);
+		if (dev)
+			device_create_file(dev, &dev_attr_cpu_capacity);
+	}
+	return 0;
+}
+device_initcall(register_cpu_capacity);
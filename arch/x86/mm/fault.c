@@ -1099,6 +1099,19 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	/*
+	 * A user fault on a not-present page of anonymous memory can
+	 * often be handled without mmap_sem, so that it does not wait
+	 * for mmap() or munmap() elsewhere in the address space:
+	 */
+	if ((error_code & (PF_USER | PF_PROT)) == PF_USER &&
+	    !handle_speculative_fault(mm, address, flags)) {
+		tsk->min_flt++;
+		perf_sw_event(PERF_COUNT_SW_PAGE_FAULTS_MIN, 1, regs, address);
+		check_v8086_mode(regs, address, tsk);
+		return;
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -228,6 +228,56 @@ void blk_delay_queue(struct request_queue *q, unsigned long msecs)
 }
 EXPORT_SYMBOL(blk_delay_queue);
 
+static enum hrtimer_restart blk_stage_timer_fn(struct hrtimer *timer)
+{
+	struct request_queue *q;
+	unsigned long flags;
+
+	q = container_of(timer, struct request_queue, stage_timer);
+	spin_lock_irqsave(q->queue_lock, flags);
+	q->stage_expired++;
+	blk_run_queue_async(q);
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Small writes are worth staging: something adjacent to them may still
+ * be on its way from another task.  Flushes, FUA writes and requests that
+ * are already as large as they can get are not.
+ */
+static bool blk_rq_stageable(struct request *rq)
+{
+	return rq_data_dir(rq) == WRITE &&
+		rq->cmd_type == REQ_TYPE_FS &&
+		!(rq->cmd_flags & (REQ_FLUSH | REQ_FUA)) &&
+		blk_rq_sectors(rq) < queue_max_sectors(rq->q);
+}
+
+/*
+ * Decide whether running @q can be left to the staging timer instead of
+ * being done right now.  The window is started by the first staged request
+ * and not pushed out by later ones, so no request waits for longer than
+ * stage_window_us.  Once a good part of the queue is sorted and waiting,
+ * there is enough to merge with already and the queue is run right away.
+ * Called with the queue lock held.
+ */
+static bool blk_stage_queue(struct request_queue *q, bool stageable)
+{
+	if (!q->stage_window_us || !stageable)
+		return false;
+	if (q->nr_sorted >= q->nr_requests / 4)
+		return false;
+
+	if (!hrtimer_active(&q->stage_timer))
+		hrtimer_start(&q->stage_timer,
+			      ns_to_ktime(q->stage_window_us * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	q->stage_staged++;
+	return true;
+}
+
 /**
  * blk_start_queue - restart a previously stopped queue
  * @q:    The &struct request_queue in question
@@ -288,6 +338,7 @@ EXPORT_SYMBOL(blk_stop_queue);
 void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->timeout);
+	hrtimer_cancel(&q->stage_timer);
 	cancel_delayed_work_sync(&q->delay_work);
 }
 EXPORT_SYMBOL(blk_sync_queue);
@@ -593,6 +644,8 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	INIT_LIST_HEAD(&q->flush_queue[1]);
 	INIT_LIST_HEAD(&q->flush_data_in_flight);
 	INIT_DELAYED_WORK(&q->delay_work, blk_delay_work);
+	hrtimer_init(&q->stage_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	q->stage_timer.function = blk_stage_timer_fn;
 
 	kobject_init(&q->kobj, &blk_queue_ktype);
 
@@ -884,6 +937,10 @@ static struct request *__get_request(struct request_list *rl, int rw_flags,
 	if (may_queue == ELV_MQUEUE_NO)
 		goto rq_starved;
 
+	/* the cgroup may be throttled to protect another's latency target */
+	if (bio && !blk_iolatency_may_queue(rl))
+		goto rq_starved;
+
 	if (rl->count[is_sync]+1 >= queue_congestion_on_threshold(q)) {
 		if (rl->count[is_sync]+1 >= q->nr_requests) {
 			/*
@@ -1459,6 +1516,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	if (el_ret == ELEVATOR_BACK_MERGE) {
 		if (bio_attempt_back_merge(q, req, bio)) {
 			elv_bio_merged(q, req, bio);
+			q->stage_merges++;
 			if (!attempt_back_merge(q, req))
 				elv_merged_request(q, req, el_ret);
 			goto out_unlock;
@@ -1466,6 +1524,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	} else if (el_ret == ELEVATOR_FRONT_MERGE) {
 		if (bio_attempt_front_merge(q, req, bio)) {
 			elv_bio_merged(q, req, bio);
+			q->stage_merges++;
 			if (!attempt_front_merge(q, req))
 				elv_merged_request(q, req, el_ret);
 			goto out_unlock;
@@ -1531,7 +1590,8 @@ get_rq:
 	} else {
 		spin_lock_irq(q->queue_lock);
 		add_acct_request(q, req, where);
-		__blk_run_queue(q);
+		if (!blk_stage_queue(q, blk_rq_stageable(req)))
+			__blk_run_queue(q);
 out_unlock:
 		spin_unlock_irq(q->queue_lock);
 	}
@@ -2425,6 +2485,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blk_iolatency_done(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
@@ -2716,6 +2777,66 @@ int blk_lld_busy(struct request_queue *q)
 }
 EXPORT_SYMBOL_GPL(blk_lld_busy);
 
+/**
+ * blk_poll - reap completed requests of a polled queue
+ * @q : the queue to poll
+ *
+ * Description:
+ *    Called by a task waiting synchronously for IO on @q to complete, in
+ *    place of sleeping until the completion interrupt.
+ *
+ * Return:
+ *    true if any request was completed.
+ */
+bool blk_poll(struct request_queue *q)
+{
+	if (!q->poll_fn || !blk_queue_io_poll(q))
+		return false;
+
+	return q->poll_fn(q) > 0;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+/**
+ * blk_poll_account - account the completion time of a polled IO
+ * @q : the queue the IO was issued to
+ * @nsec : time from submission to completion
+ */
+void blk_poll_account(struct request_queue *q, u64 nsec)
+{
+	u64 mean = q->poll_nsec;
+
+	/* running average over ~8 IOs, a lost update doesn't matter */
+	q->poll_nsec = mean ? mean - (mean >> 3) + (nsec >> 3) : nsec;
+}
+EXPORT_SYMBOL_GPL(blk_poll_account);
+
+/**
+ * blk_poll_sleep_nsecs - how long to sleep before polling
+ * @q : the queue IO was issued to
+ *
+ * Description:
+ *    Spinning for the whole completion time of an IO wastes a CPU, so
+ *    by default a polling task first sleeps for half the mean completion
+ *    time.  The io_poll_delay sysfs attribute can turn this into a fixed
+ *    delay or disable sleeping altogether.
+ *
+ * Return:
+ *    Time since submission, in ns, before polling should start.
+ */
+u64 blk_poll_sleep_nsecs(struct request_queue *q)
+{
+	int delay = ACCESS_ONCE(q->poll_delay);
+
+	if (delay < 0)
+		return 0;
+	if (delay > 0)
+		return (u64)delay * NSEC_PER_USEC;
+
+	return q->poll_nsec / 2;
+}
+EXPORT_SYMBOL_GPL(blk_poll_sleep_nsecs);
+
 /**
  * blk_rq_unprep_clone - Helper function to free all bios in a cloned request
  * @rq: the clone request to be cleaned up
@@ -2883,7 +3004,7 @@ static int plug_rq_cmp(void *priv, struct list_head *a, struct list_head *b)
  * plugger did not intend it.
  */
 static void queue_unplugged(struct request_queue *q, unsigned int depth,
-			    bool from_schedule)
+			    bool stageable, bool from_schedule)
 	__releases(q->queue_lock)
 {
 	trace_block_unplug(q, depth, !from_schedule);
@@ -2896,6 +3017,11 @@ static void queue_unplugged(struct request_queue *q, unsigned int depth,
 		return;
 	}
 
+	if (blk_stage_queue(q, stageable)) {
+		spin_unlock(q->queue_lock);
+		return;
+	}
+
 	/*
 	 * If we are punting this to kblockd, then we can safely drop
 	 * the queue_lock before waking kblockd (which needs to take
@@ -2960,6 +3086,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	struct request *rq;
 	LIST_HEAD(list);
 	unsigned int depth;
+	bool stageable;
 
 	BUG_ON(plug->magic != PLUG_MAGIC);
 
@@ -2976,6 +3103,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 
 	q = NULL;
 	depth = 0;
+	stageable = true;
 
 	/*
 	 * Save and disable interrupts here, to avoid doing it for every
@@ -2991,9 +3119,11 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 			 * This drops the queue lock
 			 */
 			if (q)
-				queue_unplugged(q, depth, from_schedule);
+				queue_unplugged(q, depth, stageable,
+						from_schedule);
 			q = rq->q;
 			depth = 0;
+			stageable = true;
 			spin_lock(q->queue_lock);
 		}
 
@@ -3005,6 +3135,9 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 			continue;
 		}
 
+		if (!blk_rq_stageable(rq))
+			stageable = false;
+
 		/*
 		 * rq is already accounted, so use raw insert
 		 */
@@ -3020,7 +3153,7 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	 * This drops the queue lock
 	 */
 	if (q)
-		queue_unplugged(q, depth, from_schedule);
+		queue_unplugged(q, depth, stageable, from_schedule);
 
 	local_irq_restore(flags);
 }
@@ -0,0 +1,364 @@
+/*
+ * Latency target based IO control for request queues
+ *
+ * A group can be given a completion latency target on a device.  When a
+ * group misses its target, all groups with a looser target (or none) have
+ * the number of requests they may have allocated on the device halved.
+ * While every target is met, throttled groups get their depth back a
+ * little at a time.  As all of this happens at request allocation and
+ * completion, it works underneath any elevator.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/sched.h>
+#include "blk-cgroup.h"
+#include "blk.h"
+
+/* Targets are evaluated, and depths adjusted, once per window */
+#define IOLAT_WINDOW_NS		(100 * NSEC_PER_MSEC)
+
+/* A group misses its target if more than this percentage of IOs are late */
+#define IOLAT_MISS_PCT		10
+
+/* Don't judge a group on fewer completions than this in a window */
+#define IOLAT_MIN_SAMPLES	4
+
+static struct blkcg_policy blkcg_policy_iolat;
+
+struct iolat_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	/* latency target, 0 if none */
+	u64 target_us;
+	u64 target_ns;
+
+	/*
+	 * Number of requests the group may have allocated on the queue,
+	 * 0 if it isn't throttled.
+	 */
+	unsigned int depth;
+
+	/* completions and misses in the current window */
+	unsigned int nr_ios;
+	unsigned int nr_missed;
+
+	/* total number of requests completed */
+	struct blkg_stat serviced;
+	/* total number of requests completed after the target */
+	struct blkg_stat missed;
+	/* total time between request allocation and completion */
+	struct blkg_stat service_time;
+	/* number of times the group's depth was reduced */
+	struct blkg_stat throttled;
+};
+
+struct iolat_data {
+	struct request_queue *queue;
+
+	/* start of the current window, in sched_clock() time */
+	u64 window_start;
+};
+
+static inline struct iolat_grp *pd_to_ig(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_ig(struct blkcg_gq *blkg)
+{
+	return pd_to_ig(blkg_to_pd(blkg, &blkcg_policy_iolat));
+}
+
+static void iolat_pd_init(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *ig = blkg_to_ig(blkg);
+
+	ig->target_us = 0;
+	ig->target_ns = 0;
+	ig->depth = 0;
+	ig->nr_ios = 0;
+	ig->nr_missed = 0;
+}
+
+static void iolat_pd_reset_stats(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *ig = blkg_to_ig(blkg);
+
+	blkg_stat_reset(&ig->serviced);
+	blkg_stat_reset(&ig->missed);
+	blkg_stat_reset(&ig->service_time);
+	blkg_stat_reset(&ig->throttled);
+}
+
+static void iolat_scale_down(struct iolat_grp *ig)
+{
+	struct request_queue *q = pd_to_blkg(&ig->pd)->q;
+	unsigned int depth = ig->depth ?: q->nr_requests;
+
+	ig->depth = max(depth / 2, 1U);
+	blkg_stat_add(&ig->throttled, 1);
+}
+
+static void iolat_scale_up(struct iolat_grp *ig)
+{
+	struct blkcg_gq *blkg = pd_to_blkg(&ig->pd);
+	struct request_list *rl = &blkg->rl;
+	unsigned int depth;
+
+	if (!ig->depth)
+		return;
+
+	depth = ig->depth + max(ig->depth / 4, 1U);
+	ig->depth = depth >= blkg->q->nr_requests ? 0 : depth;
+
+	/* the root group allocates from q->root_rl */
+	if (blkg == blkg->q->root_blkg)
+		rl = &blkg->q->root_rl;
+
+	if (waitqueue_active(&rl->wait[BLK_RW_SYNC]))
+		wake_up_all(&rl->wait[BLK_RW_SYNC]);
+	if (waitqueue_active(&rl->wait[BLK_RW_ASYNC]))
+		wake_up_all(&rl->wait[BLK_RW_ASYNC]);
+}
+
+/*
+ * End of a window.  Find the strictest target that was missed and throttle
+ * every group with a looser one.  If no target was missed, let throttled
+ * groups ramp back up.
+ */
+static void iolat_window_end(struct iolat_data *id, u64 now)
+{
+	struct request_queue *q = id->queue;
+	struct blkcg_gq *blkg;
+	struct iolat_grp *ig;
+	u64 strictest = 0;
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		ig = blkg_to_ig(blkg);
+		if (!ig->target_ns)
+			continue;
+
+		if (ig->nr_ios >= IOLAT_MIN_SAMPLES &&
+		    ig->nr_missed * 100 > ig->nr_ios * IOLAT_MISS_PCT &&
+		    (!strictest || ig->target_ns < strictest))
+			strictest = ig->target_ns;
+
+		ig->nr_ios = 0;
+		ig->nr_missed = 0;
+	}
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		ig = blkg_to_ig(blkg);
+
+		if (!strictest)
+			iolat_scale_up(ig);
+		else if (!ig->target_ns || ig->target_ns > strictest)
+			iolat_scale_down(ig);
+	}
+
+	id->window_start = now;
+}
+
+/**
+ * blk_iolatency_may_queue - may another request be allocated from @rl
+ * @rl: request_list the request would be allocated from
+ *
+ * Returns false if the group owning @rl is throttled and already has as
+ * many requests as it is allowed.  Called under queue_lock.
+ */
+bool blk_iolatency_may_queue(struct request_list *rl)
+{
+	struct iolat_grp *ig = blkg_to_ig(rl->blkg);
+
+	if (!ig || !ig->depth)
+		return true;
+
+	return rl->count[BLK_RW_SYNC] + rl->count[BLK_RW_ASYNC] < ig->depth;
+}
+
+/**
+ * blk_iolatency_done - account completion of a request
+ * @rq: request that completed
+ *
+ * Called under queue_lock.
+ */
+void blk_iolatency_done(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct iolat_data *id = q->iolat_data;
+	struct iolat_grp *ig;
+	u64 now, start, lat;
+
+	if (!id || !(rq->cmd_flags & REQ_ALLOCED) ||
+	    rq->cmd_type != REQ_TYPE_FS)
+		return;
+
+	now = sched_clock();
+	start = rq_start_time_ns(rq);
+	lat = time_after64(now, start) ? now - start : 0;
+
+	ig = blkg_to_ig(blk_rq_rl(rq)->blkg);
+	if (ig) {
+		blkg_stat_add(&ig->serviced, 1);
+		blkg_stat_add(&ig->service_time, lat);
+
+		if (ig->target_ns) {
+			ig->nr_ios++;
+			if (lat > ig->target_ns) {
+				ig->nr_missed++;
+				blkg_stat_add(&ig->missed, 1);
+			}
+		}
+	}
+
+	if (!time_after64(id->window_start, now - IOLAT_WINDOW_NS))
+		iolat_window_end(id, now);
+}
+
+static u64 iolat_prfill_target(struct seq_file *sf,
+			       struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+
+	if (!ig->target_us)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, ig->target_us);
+}
+
+static int iolat_print_target(struct cgroup *cgrp, struct cftype *cft,
+			      struct seq_file *sf)
+{
+	blkcg_print_blkgs(sf, cgroup_to_blkcg(cgrp), iolat_prfill_target,
+			  &blkcg_policy_iolat, 0, false);
+	return 0;
+}
+
+static int iolat_set_target(struct cgroup *cgrp, struct cftype *cft,
+			    const char *buf)
+{
+	struct blkcg *blkcg = cgroup_to_blkcg(cgrp);
+	struct blkg_conf_ctx ctx;
+	struct iolat_grp *ig;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolat, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ig = blkg_to_ig(ctx.blkg);
+	ig->target_us = ctx.v;
+	ig->target_ns = ctx.v * NSEC_PER_USEC;
+	ig->nr_ios = 0;
+	ig->nr_missed = 0;
+
+	blkg_conf_finish(&ctx);
+	return 0;
+}
+
+static u64 iolat_prfill_depth(struct seq_file *sf,
+			      struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+
+	if (!ig->depth)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, ig->depth);
+}
+
+static int iolat_print_depth(struct cgroup *cgrp, struct cftype *cft,
+			     struct seq_file *sf)
+{
+	blkcg_print_blkgs(sf, cgroup_to_blkcg(cgrp), iolat_prfill_depth,
+			  &blkcg_policy_iolat, 0, false);
+	return 0;
+}
+
+static int iolat_print_stat(struct cgroup *cgrp, struct cftype *cft,
+			    struct seq_file *sf)
+{
+	blkcg_print_blkgs(sf, cgroup_to_blkcg(cgrp), blkg_prfill_stat,
+			  &blkcg_policy_iolat, cft->private, true);
+	return 0;
+}
+
+static struct cftype iolat_files[] = {
+	{
+		.name = "latency.target_usec_device",
+		.read_seq_string = iolat_print_target,
+		.write_string = iolat_set_target,
+		.max_write_len = 256,
+	},
+	{
+		.name = "latency.depth",
+		.read_seq_string = iolat_print_depth,
+	},
+	{
+		.name = "latency.io_serviced",
+		.private = offsetof(struct iolat_grp, serviced),
+		.read_seq_string = iolat_print_stat,
+	},
+	{
+		.name = "latency.io_missed",
+		.private = offsetof(struct iolat_grp, missed),
+		.read_seq_string = iolat_print_stat,
+	},
+	{
+		.name = "latency.io_service_time",
+		.private = offsetof(struct iolat_grp, service_time),
+		.read_seq_string = iolat_print_stat,
+	},
+	{
+		.name = "latency.throttled",
+		.private = offsetof(struct iolat_grp, throttled),
+		.read_seq_string = iolat_print_stat,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolat = {
+	.pd_size		= sizeof(struct iolat_grp),
+	.cftypes		= iolat_files,
+
+	.pd_init_fn		= iolat_pd_init,
+	.pd_reset_stats_fn	= iolat_pd_reset_stats,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct iolat_data *id;
+	int ret;
+
+	id = kzalloc_node(sizeof(*id), GFP_KERNEL, q->node);
+	if (!id)
+		return -ENOMEM;
+
+	id->queue = q;
+	id->window_start = sched_clock();
+
+	/* activate policy */
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolat);
+	if (ret) {
+		kfree(id);
+		return ret;
+	}
+
+	q->iolat_data = id;
+	return 0;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	BUG_ON(!q->iolat_data);
+	blkcg_deactivate_policy(q, &blkcg_policy_iolat);
+	kfree(q->iolat_data);
+}
+
+static int __init iolat_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolat);
+}
+
+module_init(iolat_init);
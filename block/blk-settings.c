@@ -99,6 +99,23 @@ void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn)
 }
 EXPORT_SYMBOL_GPL(blk_queue_lld_busy);
 
+/**
+ * blk_queue_poll - set driver specific completion polling function
+ * @q:		queue
+ * @fn:		function that reaps completed requests
+ *
+ * @fn is called, without any locks held, by synchronous IO submitters
+ * spinning for completion once polling has been enabled through the
+ * queue's io_poll sysfs attribute.  It must complete any finished
+ * requests just like the driver's interrupt handler would and return
+ * the number it completed.
+ */
+void blk_queue_poll(struct request_queue *q, poll_fn *fn)
+{
+	q->poll_fn = fn;
+}
+EXPORT_SYMBOL_GPL(blk_queue_poll);
+
 /**
  * blk_set_default_limits - reset limits to default values
  * @lim:  the queue_limits structure to reset
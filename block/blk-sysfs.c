@@ -280,6 +280,79 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_io_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll_on;
+	ssize_t ret;
+
+	if (!q->poll_fn)
+		return -EINVAL;
+
+	ret = queue_var_store(&poll_on, page, count);
+
+	spin_lock_irq(q->queue_lock);
+	if (poll_on)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%d\n", q->poll_delay);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q, const char *page,
+				      size_t count)
+{
+	int val;
+
+	if (kstrtoint(page, 10, &val) || val < -1)
+		return -EINVAL;
+
+	q->poll_delay = val;
+	return count;
+}
+
+/* Longer windows would only add latency without finding more merges */
+#define BLK_STAGE_WINDOW_MAX_US	10000
+
+static ssize_t queue_stage_window_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->stage_window_us, page);
+}
+
+static ssize_t queue_stage_window_store(struct request_queue *q,
+					const char *page, size_t count)
+{
+	unsigned long usecs;
+	ssize_t ret = queue_var_store(&usecs, page, count);
+
+	if (usecs > BLK_STAGE_WINDOW_MAX_US)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	q->stage_window_us = usecs;
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_stage_stats_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%lu %lu %lu\n", q->stage_staged,
+		       q->stage_expired, q->stage_merges);
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -394,6 +467,29 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+static struct queue_sysfs_entry queue_stage_window_entry = {
+	.attr = {.name = "stage_window_us", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_stage_window_show,
+	.store = queue_stage_window_store,
+};
+
+static struct queue_sysfs_entry queue_stage_stats_entry = {
+	.attr = {.name = "stage_stats", .mode = S_IRUGO },
+	.show = queue_stage_stats_show,
+};
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -416,6 +512,10 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+	&queue_stage_window_entry.attr,
+	&queue_stage_stats_entry.attr,
 	NULL,
 };
 
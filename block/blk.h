@@ -230,4 +230,22 @@ static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline void blk_throtl_exit(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+/*
+ * Internal latency target interface
+ */
+#ifdef CONFIG_BLK_DEV_IOLATENCY
+extern bool blk_iolatency_may_queue(struct request_list *rl);
+extern void blk_iolatency_done(struct request *rq);
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+#else /* CONFIG_BLK_DEV_IOLATENCY */
+static inline bool blk_iolatency_may_queue(struct request_list *rl)
+{
+	return true;
+}
+static inline void blk_iolatency_done(struct request *rq) { }
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_DEV_IOLATENCY */
+
 #endif /* BLK_INTERNAL_H */
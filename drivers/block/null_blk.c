@@ -0,0 +1,298 @@
+/*
+ * Null block device driver.
+ *
+ * Completes every request without transferring any data, either right
+ * away or after a configurable delay, which makes it useful to measure
+ * the overhead of the block layer and of the IO paths above it.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/slab.h>
+
+struct nullb {
+	struct list_head list;
+	unsigned int index;
+	struct request_queue *q;
+	struct gendisk *disk;
+	spinlock_t lock;
+
+	/* requests waiting for their completion time, oldest first */
+	struct list_head pending;
+	unsigned int nr_pending;
+	struct hrtimer timer;
+};
+
+static LIST_HEAD(nullb_list);
+static int null_major;
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_TIMER		= 1,
+};
+
+static int nr_devices = 1;
+module_param(nr_devices, int, S_IRUGO);
+MODULE_PARM_DESC(nr_devices, "Number of devices to register");
+
+static int gb = 250;
+module_param(gb, int, S_IRUGO);
+MODULE_PARM_DESC(gb, "Size of each device in GB");
+
+static int bs = 512;
+module_param(bs, int, S_IRUGO);
+MODULE_PARM_DESC(bs, "Logical block size of each device");
+
+static int irqmode = NULL_IRQ_TIMER;
+module_param(irqmode, int, S_IRUGO);
+MODULE_PARM_DESC(irqmode, "IRQ completion handler. 0-none, 1-timer");
+
+static unsigned long completion_nsec = 10000;
+module_param(completion_nsec, ulong, S_IRUGO);
+MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
+
+static int hw_queue_depth = 64;
+module_param(hw_queue_depth, int, S_IRUGO);
+MODULE_PARM_DESC(hw_queue_depth, "Queue depth of each device. Default: 64");
+
+/*
+ * rq->deadline is owned by the block layer timeout code, which this
+ * driver doesn't use, so it holds the completion time instead.  It is
+ * kept in ns truncated to a long, and only compared with time_after(),
+ * which is fine as long as completion_nsec is well below a second.
+ */
+static inline void null_rq_set_due(struct request *rq, ktime_t now)
+{
+	rq->deadline = (unsigned long)ktime_to_ns(now) + completion_nsec;
+}
+
+static inline bool null_rq_is_due(struct request *rq, ktime_t now)
+{
+	return !time_after(rq->deadline, (unsigned long)ktime_to_ns(now));
+}
+
+/*
+ * Complete all requests whose completion time has passed.  Called with
+ * the queue lock held, from the timer and from the poll function.
+ */
+static int null_complete_due(struct nullb *nullb, ktime_t now)
+{
+	struct request *rq, *tmp;
+	int nr = 0;
+
+	list_for_each_entry_safe(rq, tmp, &nullb->pending, queuelist) {
+		if (!null_rq_is_due(rq, now))
+			break;
+
+		list_del_init(&rq->queuelist);
+		nullb->nr_pending--;
+		__blk_end_request_all(rq, 0);
+		nr++;
+	}
+
+	return nr;
+}
+
+static void null_arm_timer(struct nullb *nullb)
+{
+	struct request *rq;
+
+	if (list_empty(&nullb->pending))
+		return;
+
+	rq = list_first_entry(&nullb->pending, struct request, queuelist);
+	hrtimer_start(&nullb->timer,
+		      ns_to_ktime((long)(rq->deadline - (unsigned long)ktime_to_ns(ktime_get()))),
+		      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart null_timer_fn(struct hrtimer *timer)
+{
+	struct nullb *nullb = container_of(timer, struct nullb, timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&nullb->lock, flags);
+	null_complete_due(nullb, ktime_get());
+	null_arm_timer(nullb);
+	if (blk_queue_stopped(nullb->q)) {
+		blk_start_queue(nullb->q);
+		__blk_run_queue(nullb->q);
+	}
+	spin_unlock_irqrestore(&nullb->lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+static int null_poll(struct request_queue *q)
+{
+	struct nullb *nullb = q->queuedata;
+	unsigned long flags;
+	int nr;
+
+	spin_lock_irqsave(&nullb->lock, flags);
+	nr = null_complete_due(nullb, ktime_get());
+	spin_unlock_irqrestore(&nullb->lock, flags);
+
+	return nr;
+}
+
+static void null_request_fn(struct request_queue *q)
+{
+	struct nullb *nullb = q->queuedata;
+	struct request *rq;
+	bool was_empty = list_empty(&nullb->pending);
+
+	while (nullb->nr_pending < hw_queue_depth &&
+	       (rq = blk_fetch_request(q)) != NULL) {
+		if (irqmode == NULL_IRQ_NONE) {
+			__blk_end_request_all(rq, 0);
+			continue;
+		}
+
+		null_rq_set_due(rq, ktime_get());
+		list_add_tail(&rq->queuelist, &nullb->pending);
+		nullb->nr_pending++;
+	}
+
+	/* restarted by the timer once requests complete */
+	if (nullb->nr_pending >= hw_queue_depth)
+		blk_stop_queue(q);
+
+	if (was_empty)
+		null_arm_timer(nullb);
+}
+
+static int null_open(struct block_device *bdev, fmode_t mode)
+{
+	return 0;
+}
+
+static int null_release(struct gendisk *disk, fmode_t mode)
+{
+	return 0;
+}
+
+static const struct block_device_operations null_ops = {
+	.owner =	THIS_MODULE,
+	.open =		null_open,
+	.release =	null_release,
+};
+
+static int null_add_dev(unsigned int index)
+{
+	struct gendisk *disk;
+	struct nullb *nullb;
+	sector_t size;
+
+	nullb = kzalloc(sizeof(*nullb), GFP_KERNEL);
+	if (!nullb)
+		return -ENOMEM;
+
+	nullb->index = index;
+	spin_lock_init(&nullb->lock);
+	INIT_LIST_HEAD(&nullb->pending);
+	hrtimer_init(&nullb->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	nullb->timer.function = null_timer_fn;
+
+	nullb->q = blk_init_queue(null_request_fn, &nullb->lock);
+	if (!nullb->q)
+		goto out_free_nullb;
+
+	nullb->q->queuedata = nullb;
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
+	blk_queue_logical_block_size(nullb->q, bs);
+	blk_queue_physical_block_size(nullb->q, bs);
+	if (irqmode == NULL_IRQ_TIMER)
+		blk_queue_poll(nullb->q, null_poll);
+
+	disk = nullb->disk = alloc_disk(1);
+	if (!disk)
+		goto out_cleanup_queue;
+
+	size = gb * 1024 * 1024 * 1024ULL;
+	set_capacity(disk, size >> 9);
+
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major		= null_major;
+	disk->first_minor	= index;
+	disk->fops		= &null_ops;
+	disk->private_data	= nullb;
+	disk->queue		= nullb->q;
+	sprintf(disk->disk_name, "nullb%d", index);
+	add_disk(disk);
+
+	list_add_tail(&nullb->list, &nullb_list);
+	return 0;
+
+out_cleanup_queue:
+	blk_cleanup_queue(nullb->q);
+out_free_nullb:
+	kfree(nullb);
+	return -ENOMEM;
+}
+
+static void null_del_dev(struct nullb *nullb)
+{
+	list_del_init(&nullb->list);
+
+	del_gendisk(nullb->disk);
+	blk_cleanup_queue(nullb->q);
+	hrtimer_cancel(&nullb->timer);
+	put_disk(nullb->disk);
+	kfree(nullb);
+}
+
+static int __init null_init(void)
+{
+	unsigned int i;
+	int ret;
+
+	if (bs > PAGE_SIZE || bs < 512 || !is_power_of_2(bs)) {
+		pr_warn("null_blk: invalid block size %d, using 512\n", bs);
+		bs = 512;
+	}
+
+	if (irqmode != NULL_IRQ_NONE && irqmode != NULL_IRQ_TIMER) {
+		pr_warn("null_blk: invalid irqmode %d, using timer\n", irqmode);
+		irqmode = NULL_IRQ_TIMER;
+	}
+
+	if (hw_queue_depth < 1)
+		hw_queue_depth = 1;
+
+	null_major = register_blkdev(0, "nullb");
+	if (null_major < 0)
+		return null_major;
+
+	for (i = 0; i < nr_devices; i++) {
+		ret = null_add_dev(i);
+		if (ret)
+			goto out;
+	}
+
+	pr_info("null_blk: module loaded\n");
+	return 0;
+
+out:
+	while (!list_empty(&nullb_list))
+		null_del_dev(list_first_entry(&nullb_list, struct nullb, list));
+	unregister_blkdev(null_major, "nullb");
+	return ret;
+}
+
+static void __exit null_exit(void)
+{
+	unregister_blkdev(null_major, "nullb");
+
+	while (!list_empty(&nullb_list))
+		null_del_dev(list_first_entry(&nullb_list, struct nullb, list));
+}
+
+module_init(null_init);
+module_exit(null_exit);
+
+MODULE_LICENSE("GPL");
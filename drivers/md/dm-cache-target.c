@@ -0,0 +1,1477 @@
+/*
+ * This file is released under the GPL.
+ */
+
+#include "dm-cache-metadata.h"
+#include "dm-bio-record.h"
+
+#include <linux/device-mapper.h>
+#include <linux/dm-io.h>
+#include <linux/dm-kcopyd.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/list.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#define	DM_MSG_PREFIX	"cache"
+
+/*
+ * Tunable constants
+ */
+#define ENDIO_HOOK_POOL_SIZE 1024
+#define MAX_MIGRATIONS 32
+#define COMMIT_PERIOD HZ
+#define DEFAULT_PROMOTE_THRESHOLD 4
+#define HITS_PER_CBLOCK 4
+#define LRU_SCAN_LIMIT 16
+
+/*
+ * Writeback caches start cleaning in the background once this percentage
+ * of the cache is dirty, or whenever the device went idle for a commit
+ * period.
+ */
+#define DIRTY_HIGH_WATERMARK 50
+
+/*
+ * The block size of the device holding cache data must be
+ * between 32KB and 1GB.
+ */
+#define DATA_DEV_BLOCK_SIZE_MIN_SECTORS (32 * 1024 >> SECTOR_SHIFT)
+#define DATA_DEV_BLOCK_SIZE_MAX_SECTORS (1024 * 1024 * 1024 >> SECTOR_SHIFT)
+
+/*----------------------------------------------------------------*/
+
+/*
+ * How it works:
+ *
+ * A cache target sits in front of a slow origin device.  The fast cache
+ * device is split into fixed size blocks, each of which can hold a copy
+ * of one origin block.  Which origin block each cache block holds is
+ * recorded on the metadata device (see dm-cache-metadata.c).
+ *
+ * Bios to origin blocks that are not in the cache are remapped to the
+ * origin.  Every such miss bumps a small, periodically halved, hit
+ * counter for the origin block.  Once it crosses the promotion threshold
+ * a free, or the least recently used clean, cache block is picked and
+ * the origin block is copied into it with kcopyd.  Any io to a block
+ * while it is being migrated is deferred to the worker until the
+ * migration is over.  The copy itself waits for the writes already
+ * issued to the origin block to complete, so that it reads their data.
+ *
+ * In writeback mode writes that hit the cache only go to the cache
+ * device and mark the block dirty.  Dirty blocks are copied back to the
+ * origin in the background by the worker.  In writethrough mode such
+ * writes are first sent to the origin and then, from the worker, to the
+ * cache device, so the cache never holds the only copy of any data.
+ *
+ * Data in a cache block is only trusted once the mapping has been
+ * committed, so a crash at any point leaves either the old or the new
+ * mapping, never a half copied block.  Dirty flags are written out only
+ * when the device is suspended; after a crash every block is treated as
+ * dirty.
+ */
+
+enum cache_mode {
+	CM_WRITEBACK,
+	CM_WRITETHROUGH,
+};
+
+struct cache_features {
+	enum cache_mode mode;
+	unsigned promote_threshold;
+};
+
+enum migration_op {
+	MIGRATE_PROMOTE,	/* origin -> cache */
+	MIGRATE_CLEAN,		/* cache -> origin */
+};
+
+/*
+ * One per cache block.
+ */
+struct cblock_entry {
+	struct cache *cache;
+	struct hlist_node hlist;	/* keyed on oblock */
+
+	/*
+	 * Free list, lru, or one of the migration lists while
+	 * migrating.
+	 */
+	struct list_head list;
+
+	dm_oblock_t oblock;
+
+	/*
+	 * Bios in flight to this cache block.  The block can't be
+	 * reused until they have all completed.
+	 */
+	atomic_t pending;
+
+	unsigned valid:1;		/* holds the data of oblock */
+	unsigned dirty:1;		/* newer than the origin */
+	unsigned meta_dirty:1;		/* dirty flag in the metadata */
+	unsigned migrating:1;
+	unsigned evicted:1;		/* old mapping must be removed first */
+	unsigned op:1;			/* enum migration_op */
+	int err;
+};
+
+struct cache_stats {
+	atomic_t read_hit;
+	atomic_t read_miss;
+	atomic_t write_hit;
+	atomic_t write_miss;
+	atomic_t promotion;
+	atomic_t demotion;
+};
+
+struct cache {
+	struct dm_target *ti;
+	struct dm_target_callbacks callbacks;
+
+	struct dm_dev *metadata_dev;
+	struct dm_dev *origin_dev;
+	struct dm_dev *cache_dev;
+
+	struct cache_features features;
+
+	sector_t sectors_per_block;
+	int sectors_per_block_shift;
+	dm_cblock_t nr_cblocks;
+
+	struct dm_cache_metadata *cmd;
+	bool loaded_mappings:1;
+	bool suspended:1;
+	bool commit_failed:1;
+
+	spinlock_t lock;
+	struct cblock_entry *blocks;
+	struct list_head free;
+	struct list_head lru;		/* least recently used first */
+	struct hlist_head *buckets;
+	unsigned hash_bits;
+	dm_cblock_t nr_dirty;
+
+	/*
+	 * Hit counters for blocks that aren't cached, indexed by a hash
+	 * of the origin block.  Collisions only cause early promotions.
+	 */
+	u8 *hits;
+	unsigned hits_bits;
+	unsigned long nr_misses;
+	bool age_hits;			/* the worker must halve them */
+
+	/*
+	 * Writes in flight to origin blocks that aren't cached, indexed
+	 * by a hash of the origin block, like buckets.  A promotion can't
+	 * start copying until the counter of its block drops to zero.
+	 * Collisions only delay promotions.
+	 */
+	atomic_t *origin_writes;
+
+	struct bio_list deferred_bios;
+	struct bio_list waiting_bios;
+	struct bio_list writethrough_bios;
+	struct list_head new_migrations;
+	struct list_head completed_migrations;
+	atomic_t nr_migrations;
+	wait_queue_head_t migration_wait;
+	unsigned long last_io_jiffies;
+
+	struct dm_kcopyd_client *copier;
+	struct workqueue_struct *wq;
+	struct work_struct worker;
+	struct delayed_work waker;
+
+	mempool_t *endio_hook_pool;
+
+	struct cache_stats stats;
+};
+
+struct dm_cache_endio_hook {
+	struct cache *cache;
+	struct cblock_entry *e;		/* cache block used, or NULL */
+	bool writethrough:1;		/* cache leg still to be issued */
+	atomic_t *origin_write;		/* counter of the write, or NULL */
+	struct dm_bio_details details;
+};
+
+static struct kmem_cache *_endio_hook_cache;
+
+/*----------------------------------------------------------------*/
+
+static dm_cblock_t to_cblock(struct cache *cache, struct cblock_entry *e)
+{
+	return e - cache->blocks;
+}
+
+static dm_oblock_t get_bio_block(struct cache *cache, struct bio *bio)
+{
+	return dm_target_offset(cache->ti, bio->bi_sector) >>
+		cache->sectors_per_block_shift;
+}
+
+static struct hlist_head *oblock_bucket(struct cache *cache, dm_oblock_t oblock)
+{
+	return cache->buckets + hash_64(oblock, cache->hash_bits);
+}
+
+static struct cblock_entry *__lookup(struct cache *cache, dm_oblock_t oblock)
+{
+	struct cblock_entry *e;
+	struct hlist_node *tmp;
+
+	hlist_for_each_entry(e, tmp, oblock_bucket(cache, oblock), hlist)
+		if (e->oblock == oblock)
+			return e;
+
+	return NULL;
+}
+
+static void __insert(struct cache *cache, struct cblock_entry *e)
+{
+	hlist_add_head(&e->hlist, oblock_bucket(cache, e->oblock));
+}
+
+static u8 *hit_counter(struct cache *cache, dm_oblock_t oblock)
+{
+	return cache->hits + hash_64(oblock, cache->hits_bits);
+}
+
+static atomic_t *origin_write_counter(struct cache *cache, dm_oblock_t oblock)
+{
+	return cache->origin_writes + hash_64(oblock, cache->hash_bits);
+}
+
+static void __set_dirty(struct cache *cache, struct cblock_entry *e)
+{
+	if (!e->dirty) {
+		e->dirty = 1;
+		cache->nr_dirty++;
+	}
+}
+
+static void __clear_dirty(struct cache *cache, struct cblock_entry *e)
+{
+	if (e->dirty) {
+		e->dirty = 0;
+		cache->nr_dirty--;
+	}
+}
+
+/*----------------------------------------------------------------
+ * Remapping
+ *--------------------------------------------------------------*/
+
+static void remap_to_origin(struct cache *cache, struct bio *bio)
+{
+	bio->bi_bdev = cache->origin_dev->bdev;
+	bio->bi_sector = dm_target_offset(cache->ti, bio->bi_sector);
+}
+
+static void remap_to_cache(struct cache *cache, struct bio *bio,
+			   struct cblock_entry *e)
+{
+	sector_t bi_sector = dm_target_offset(cache->ti, bio->bi_sector);
+
+	bio->bi_bdev = cache->cache_dev->bdev;
+	bio->bi_sector = ((sector_t)to_cblock(cache, e) << cache->sectors_per_block_shift) |
+		(bi_sector & (cache->sectors_per_block - 1));
+}
+
+/*
+ * wake_worker() is used when new work is queued and when cache_resume is
+ * ready to continue deferred IO processing.
+ */
+static void wake_worker(struct cache *cache)
+{
+	queue_work(cache->wq, &cache->worker);
+}
+
+/*
+ * Bios to blocks that are being migrated are held back until a migration
+ * completes.
+ */
+static void __defer_bio(struct cache *cache, struct bio *bio)
+{
+	bio_list_add(&cache->waiting_bios, bio);
+}
+
+/*----------------------------------------------------------------
+ * Picking blocks to migrate
+ *--------------------------------------------------------------*/
+
+/*
+ * Find a cache block for a promotion.  Free blocks are used first,
+ * otherwise the least recently used clean block that is not busy is
+ * evicted.  Only the head of the lru is looked at to bound the time
+ * spent under the lock.
+ */
+static struct cblock_entry *__find_victim(struct cache *cache)
+{
+	unsigned scanned = 0;
+	struct cblock_entry *e;
+
+	if (!list_empty(&cache->free))
+		return list_first_entry(&cache->free, struct cblock_entry, list);
+
+	list_for_each_entry(e, &cache->lru, list) {
+		if (scanned++ >= LRU_SCAN_LIMIT)
+			break;
+
+		if (!e->dirty && !atomic_read(&e->pending))
+			return e;
+	}
+
+	return NULL;
+}
+
+static void __start_migration(struct cache *cache, struct cblock_entry *e,
+			      enum migration_op op)
+{
+	e->migrating = 1;
+	e->op = op;
+	e->err = 0;
+	list_move_tail(&e->list, &cache->new_migrations);
+	atomic_inc(&cache->nr_migrations);
+	wake_worker(cache);
+}
+
+/*
+ * Called for every miss.  Returns true if a promotion was started, in
+ * which case the block is now hashed as migrating.
+ */
+static bool __maybe_promote(struct cache *cache, dm_oblock_t oblock)
+{
+	u8 *hits = hit_counter(cache, oblock);
+	struct cblock_entry *e;
+
+	if (*hits < 255)
+		(*hits)++;
+
+	/* Forget old hits, see age_hit_counters() */
+	if (++cache->nr_misses >= (1UL << cache->hits_bits)) {
+		cache->nr_misses = 0;
+		cache->age_hits = true;
+		wake_worker(cache);
+	}
+
+	if (*hits < cache->features.promote_threshold ||
+	    cache->suspended ||
+	    atomic_read(&cache->nr_migrations) >= MAX_MIGRATIONS)
+		return false;
+
+	e = __find_victim(cache);
+	if (!e)
+		return false;
+
+	if (e->valid) {
+		hlist_del(&e->hlist);
+		e->valid = 0;
+		e->evicted = 1;
+		atomic_inc(&cache->stats.demotion);
+	}
+
+	*hits = 0;
+	e->oblock = oblock;
+	__insert(cache, e);
+	__start_migration(cache, e, MIGRATE_PROMOTE);
+	atomic_inc(&cache->stats.promotion);
+
+	return true;
+}
+
+/*
+ * Start writing back dirty blocks, least recently used first.
+ */
+static void start_cleaning(struct cache *cache)
+{
+	unsigned long flags;
+	unsigned scanned = 0;
+	bool idle;
+	struct cblock_entry *e, *tmp;
+
+	if (cache->features.mode != CM_WRITEBACK)
+		return;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	idle = time_after(jiffies, cache->last_io_jiffies + COMMIT_PERIOD);
+	if (!cache->nr_dirty || cache->suspended ||
+	    (!idle && cache->nr_dirty * 100 <
+	     (u64)cache->nr_cblocks * DIRTY_HIGH_WATERMARK))
+		goto out;
+
+	list_for_each_entry_safe(e, tmp, &cache->lru, list) {
+		if (atomic_read(&cache->nr_migrations) >= MAX_MIGRATIONS ||
+		    scanned++ >= MAX_MIGRATIONS * LRU_SCAN_LIMIT)
+			break;
+
+		if (e->dirty && !atomic_read(&e->pending))
+			__start_migration(cache, e, MIGRATE_CLEAN);
+	}
+out:
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*----------------------------------------------------------------
+ * Bio processing
+ *--------------------------------------------------------------*/
+
+/*
+ * Returns DM_MAPIO_REMAPPED if the bio should be issued, or
+ * DM_MAPIO_SUBMITTED if it has been deferred.
+ */
+static int __map_bio(struct cache *cache, struct bio *bio,
+		     struct dm_cache_endio_hook *h)
+{
+	dm_oblock_t oblock = get_bio_block(cache, bio);
+	bool write = bio_data_dir(bio) == WRITE;
+	struct cblock_entry *e;
+
+	cache->last_io_jiffies = jiffies;
+
+	e = __lookup(cache, oblock);
+	if (!e) {
+		atomic_inc(write ? &cache->stats.write_miss :
+			   &cache->stats.read_miss);
+
+		if (__maybe_promote(cache, oblock)) {
+			__defer_bio(cache, bio);
+			return DM_MAPIO_SUBMITTED;
+		}
+
+		if (write) {
+			h->origin_write = origin_write_counter(cache, oblock);
+			atomic_inc(h->origin_write);
+		}
+
+		remap_to_origin(cache, bio);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	/*
+	 * Reads may still be served from a block that is being cleaned,
+	 * anything else has to wait for the migration to finish.
+	 */
+	if (e->migrating && (e->op == MIGRATE_PROMOTE || write)) {
+		__defer_bio(cache, bio);
+		return DM_MAPIO_SUBMITTED;
+	}
+
+	atomic_inc(write ? &cache->stats.write_hit : &cache->stats.read_hit);
+	atomic_inc(&e->pending);
+	h->e = e;
+
+	if (!e->migrating)
+		list_move_tail(&e->list, &cache->lru);
+
+	if (write && cache->features.mode == CM_WRITETHROUGH) {
+		dm_bio_record(&h->details, bio);
+		h->writethrough = true;
+		remap_to_origin(cache, bio);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	if (write)
+		__set_dirty(cache, e);
+
+	remap_to_cache(cache, bio, e);
+	return DM_MAPIO_REMAPPED;
+}
+
+static void process_deferred_bios(struct cache *cache)
+{
+	unsigned long flags;
+	struct bio *bio;
+	struct bio_list bios;
+	int r;
+
+	bio_list_init(&bios);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	bio_list_merge(&bios, &cache->deferred_bios);
+	bio_list_init(&cache->deferred_bios);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	while ((bio = bio_list_pop(&bios))) {
+		struct dm_cache_endio_hook *h = dm_get_mapinfo(bio)->ptr;
+
+		spin_lock_irqsave(&cache->lock, flags);
+		r = __map_bio(cache, bio, h);
+		spin_unlock_irqrestore(&cache->lock, flags);
+
+		if (r == DM_MAPIO_REMAPPED)
+			generic_make_request(bio);
+	}
+}
+
+/*
+ * The origin leg of these writethrough bios has completed, now write the
+ * same data to the cache block.
+ */
+static void process_writethrough_bios(struct cache *cache)
+{
+	unsigned long flags;
+	struct bio *bio;
+	struct bio_list bios;
+
+	bio_list_init(&bios);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	bio_list_merge(&bios, &cache->writethrough_bios);
+	bio_list_init(&cache->writethrough_bios);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	while ((bio = bio_list_pop(&bios))) {
+		struct dm_cache_endio_hook *h = dm_get_mapinfo(bio)->ptr;
+
+		remap_to_cache(cache, bio, h->e);
+		generic_make_request(bio);
+	}
+}
+
+/*----------------------------------------------------------------
+ * Migrations
+ *--------------------------------------------------------------*/
+
+static void copy_complete(int read_err, unsigned long write_err, void *context)
+{
+	unsigned long flags;
+	struct cblock_entry *e = context;
+	struct cache *cache = e->cache;
+
+	if (read_err || write_err)
+		e->err = -EIO;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_add_tail(&e->list, &cache->completed_migrations);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_worker(cache);
+}
+
+static void issue_copy(struct cache *cache, struct cblock_entry *e)
+{
+	int r;
+	struct dm_io_region o_region, c_region;
+
+	o_region.bdev = cache->origin_dev->bdev;
+	o_region.sector = e->oblock << cache->sectors_per_block_shift;
+	o_region.count = cache->sectors_per_block;
+
+	c_region.bdev = cache->cache_dev->bdev;
+	c_region.sector = (sector_t)to_cblock(cache, e) << cache->sectors_per_block_shift;
+	c_region.count = cache->sectors_per_block;
+
+	if (e->op == MIGRATE_PROMOTE)
+		r = dm_kcopyd_copy(cache->copier, &o_region, 1, &c_region,
+				   0, copy_complete, e);
+	else
+		r = dm_kcopyd_copy(cache->copier, &c_region, 1, &o_region,
+				   0, copy_complete, e);
+
+	if (r < 0) {
+		DMERR_LIMIT("dm_kcopyd_copy() failed");
+		e->err = r;
+		copy_complete(0, 0, e);
+	}
+}
+
+/*
+ * Removes the metadata mappings of blocks that are about to be reused and
+ * commits, so that a crash during the copy can't leave a cache block
+ * whose mapping points at the wrong data.
+ */
+static int remove_evicted_mappings(struct cache *cache, struct list_head *head)
+{
+	int r;
+	bool changed = false;
+	struct cblock_entry *e;
+
+	list_for_each_entry(e, head, list) {
+		if (!e->evicted)
+			continue;
+
+		r = dm_cache_remove_mapping(cache->cmd, to_cblock(cache, e));
+		if (r)
+			return r;
+
+		e->evicted = 0;
+		e->meta_dirty = 0;
+		changed = true;
+	}
+
+	return changed ? dm_cache_commit(cache->cmd, false) : 0;
+}
+
+/*
+ * Promotions stay on new_migrations until the writes in flight to their
+ * origin block have completed; cache_end_io() wakes the worker then.
+ * New writes to the block are deferred since it is migrating.
+ */
+static void process_new_migrations(struct cache *cache)
+{
+	int r;
+	unsigned long flags;
+	struct list_head migrations;
+	struct cblock_entry *e, *tmp;
+
+	INIT_LIST_HEAD(&migrations);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_for_each_entry_safe(e, tmp, &cache->new_migrations, list)
+		if (e->op != MIGRATE_PROMOTE ||
+		    !atomic_read(origin_write_counter(cache, e->oblock)))
+			list_move_tail(&e->list, &migrations);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	if (list_empty(&migrations))
+		return;
+
+	r = remove_evicted_mappings(cache, &migrations);
+	if (r) {
+		DMERR_LIMIT("couldn't remove evicted mappings, error = %d", r);
+		cache->commit_failed = true;
+	}
+
+	list_for_each_entry_safe(e, tmp, &migrations, list) {
+		if (r) {
+			e->err = r;
+			spin_lock_irqsave(&cache->lock, flags);
+			list_move_tail(&e->list, &cache->completed_migrations);
+			spin_unlock_irqrestore(&cache->lock, flags);
+			continue;
+		}
+
+		list_del_init(&e->list);
+		issue_copy(cache, e);
+	}
+
+	if (r)
+		wake_worker(cache);
+}
+
+static void finish_migration(struct cache *cache, struct cblock_entry *e)
+{
+	if (e->op == MIGRATE_PROMOTE) {
+		e->migrating = 0;
+		if (e->err) {
+			hlist_del(&e->hlist);
+			list_add(&e->list, &cache->free);
+		} else {
+			e->valid = 1;
+			list_add_tail(&e->list, &cache->lru);
+		}
+
+	} else {
+		e->migrating = 0;
+		if (!e->err)
+			__clear_dirty(cache, e);
+
+		/* It was least recently used before, keep it that way */
+		list_add(&e->list, &cache->lru);
+	}
+
+	if (atomic_dec_and_test(&cache->nr_migrations))
+		wake_up(&cache->migration_wait);
+}
+
+static void process_completed_migrations(struct cache *cache)
+{
+	int r = 0;
+	unsigned long flags;
+	bool changed = false;
+	struct list_head migrations;
+	struct cblock_entry *e, *tmp;
+
+	INIT_LIST_HEAD(&migrations);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_splice_init(&cache->completed_migrations, &migrations);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	if (list_empty(&migrations))
+		return;
+
+	/*
+	 * New mappings have to hit the disk before any io is let through
+	 * to the promoted blocks.
+	 */
+	list_for_each_entry(e, &migrations, list) {
+		if (e->op != MIGRATE_PROMOTE || e->err)
+			continue;
+
+		r = dm_cache_insert_mapping(cache->cmd, to_cblock(cache, e),
+					    e->oblock, false);
+		if (r)
+			break;
+
+		e->meta_dirty = 0;
+		changed = true;
+	}
+
+	if (!r && changed)
+		r = dm_cache_commit(cache->cmd, false);
+
+	if (r) {
+		DMERR_LIMIT("couldn't commit new mappings, error = %d", r);
+		cache->commit_failed = true;
+		list_for_each_entry(e, &migrations, list)
+			if (e->op == MIGRATE_PROMOTE && !e->err)
+				e->err = r;
+	}
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_for_each_entry_safe(e, tmp, &migrations, list) {
+		list_del_init(&e->list);
+		finish_migration(cache, e);
+	}
+
+	/* Anything waiting on these blocks can be retried */
+	bio_list_merge(&cache->deferred_bios, &cache->waiting_bios);
+	bio_list_init(&cache->waiting_bios);
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Halve the hit counters.  This is done without the lock, which would
+ * keep interrupts off for the whole table: an increment racing with it
+ * may be lost, which only delays a promotion.
+ */
+static void age_hit_counters(struct cache *cache)
+{
+	unsigned long i;
+
+	if (!cache->age_hits)
+		return;
+	cache->age_hits = false;
+
+	for (i = 0; i < (1UL << cache->hits_bits); i++) {
+		cache->hits[i] >>= 1;
+		if (!(i & 4095))
+			cond_resched();
+	}
+}
+
+static void do_worker(struct work_struct *ws)
+{
+	struct cache *cache = container_of(ws, struct cache, worker);
+
+	age_hit_counters(cache);
+	process_completed_migrations(cache);
+	process_writethrough_bios(cache);
+	process_deferred_bios(cache);
+	process_new_migrations(cache);
+	start_cleaning(cache);
+}
+
+/*
+ * We want to start cleaning when the device goes idle, so the worker has
+ * to run periodically.
+ */
+static void do_waker(struct work_struct *ws)
+{
+	struct cache *cache = container_of(to_delayed_work(ws), struct cache, waker);
+	wake_worker(cache);
+	queue_delayed_work(cache->wq, &cache->waker, COMMIT_PERIOD);
+}
+
+/*----------------------------------------------------------------
+ * Target methods
+ *--------------------------------------------------------------*/
+
+static int cache_is_congested(struct dm_target_callbacks *cb, int bdi_bits)
+{
+	struct cache *cache = container_of(cb, struct cache, callbacks);
+	struct request_queue *q = bdev_get_queue(cache->origin_dev->bdev);
+
+	if (bdi_congested(&q->backing_dev_info, bdi_bits))
+		return 1;
+
+	q = bdev_get_queue(cache->cache_dev->bdev);
+	return bdi_congested(&q->backing_dev_info, bdi_bits);
+}
+
+static void cache_features_init(struct cache_features *cf)
+{
+	cf->mode = CM_WRITEBACK;
+	cf->promote_threshold = DEFAULT_PROMOTE_THRESHOLD;
+}
+
+static int parse_cache_features(struct dm_arg_set *as, struct cache_features *cf,
+				struct dm_target *ti)
+{
+	int r;
+	unsigned argc;
+	const char *arg_name;
+
+	static struct dm_arg _args[] = {
+		{0, 3, "Invalid number of cache feature arguments"},
+	};
+
+	/*
+	 * No feature arguments supplied.
+	 */
+	if (!as->argc)
+		return 0;
+
+	r = dm_read_arg_group(_args, as, &argc, &ti->error);
+	if (r)
+		return -EINVAL;
+
+	while (argc && !r) {
+		arg_name = dm_shift_arg(as);
+		argc--;
+
+		if (!strcasecmp(arg_name, "writeback"))
+			cf->mode = CM_WRITEBACK;
+
+		else if (!strcasecmp(arg_name, "writethrough"))
+			cf->mode = CM_WRITETHROUGH;
+
+		else if (!strcasecmp(arg_name, "promote_threshold") && argc) {
+			argc--;
+			if (kstrtouint(dm_shift_arg(as), 10, &cf->promote_threshold) ||
+			    !cf->promote_threshold) {
+				ti->error = "Invalid promote_threshold";
+				r = -EINVAL;
+			}
+
+		} else {
+			ti->error = "Unrecognised cache feature requested";
+			r = -EINVAL;
+		}
+	}
+
+	return r;
+}
+
+static void cache_destroy(struct cache *cache)
+{
+	if (cache->cmd)
+		dm_cache_metadata_close(cache->cmd);
+
+	if (cache->wq)
+		destroy_workqueue(cache->wq);
+
+	if (cache->copier)
+		dm_kcopyd_client_destroy(cache->copier);
+
+	if (cache->endio_hook_pool)
+		mempool_destroy(cache->endio_hook_pool);
+
+	vfree(cache->origin_writes);
+	vfree(cache->hits);
+	vfree(cache->buckets);
+	vfree(cache->blocks);
+	kfree(cache);
+}
+
+static struct cache *cache_create(struct dm_target *ti, sector_t block_size,
+				  dm_cblock_t nr_cblocks, char **error)
+{
+	dm_cblock_t i;
+	struct cache *cache;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache) {
+		*error = "Error allocating memory for cache";
+		return ERR_PTR(-ENOMEM);
+	}
+
+	cache->ti = ti;
+	cache->sectors_per_block = block_size;
+	cache->sectors_per_block_shift = __ffs(block_size);
+	cache->nr_cblocks = nr_cblocks;
+
+	spin_lock_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->free);
+	INIT_LIST_HEAD(&cache->lru);
+	INIT_LIST_HEAD(&cache->new_migrations);
+	INIT_LIST_HEAD(&cache->completed_migrations);
+	bio_list_init(&cache->deferred_bios);
+	bio_list_init(&cache->waiting_bios);
+	bio_list_init(&cache->writethrough_bios);
+	atomic_set(&cache->nr_migrations, 0);
+	init_waitqueue_head(&cache->migration_wait);
+	cache->last_io_jiffies = jiffies;
+
+	cache->blocks = vzalloc(sizeof(*cache->blocks) * nr_cblocks);
+	if (!cache->blocks)
+		goto bad_alloc;
+
+	for (i = 0; i < nr_cblocks; i++) {
+		struct cblock_entry *e = cache->blocks + i;
+
+		e->cache = cache;
+		atomic_set(&e->pending, 0);
+		INIT_HLIST_NODE(&e->hlist);
+		list_add_tail(&e->list, &cache->free);
+	}
+
+	cache->hash_bits = max_t(unsigned, ilog2(nr_cblocks), 4);
+	cache->buckets = vzalloc(sizeof(*cache->buckets) << cache->hash_bits);
+	if (!cache->buckets)
+		goto bad_alloc;
+
+	cache->origin_writes = vzalloc(sizeof(*cache->origin_writes) <<
+				       cache->hash_bits);
+	if (!cache->origin_writes)
+		goto bad_alloc;
+
+	cache->hits_bits = ilog2(nr_cblocks * HITS_PER_CBLOCK);
+	cache->hits = vzalloc(1UL << cache->hits_bits);
+	if (!cache->hits)
+		goto bad_alloc;
+
+	cache->endio_hook_pool = mempool_create_slab_pool(ENDIO_HOOK_POOL_SIZE,
+							  _endio_hook_cache);
+	if (!cache->endio_hook_pool)
+		goto bad_alloc;
+
+	cache->copier = dm_kcopyd_client_create();
+	if (IS_ERR(cache->copier)) {
+		*error = "Error creating cache's kcopyd client";
+		cache->copier = NULL;
+		goto bad;
+	}
+
+	/*
+	 * Create singlethreaded workqueue that will service all devices
+	 * that use this metadata.
+	 */
+	cache->wq = alloc_ordered_workqueue("dm-" DM_MSG_PREFIX, WQ_MEM_RECLAIM);
+	if (!cache->wq) {
+		*error = "Error creating cache's workqueue";
+		goto bad;
+	}
+
+	INIT_WORK(&cache->worker, do_worker);
+	INIT_DELAYED_WORK(&cache->waker, do_waker);
+
+	return cache;
+
+bad_alloc:
+	*error = "Error allocating memory for cache";
+bad:
+	cache_destroy(cache);
+	return ERR_PTR(-ENOMEM);
+}
+
+/*
+ * Construct a cache device mapping:
+ *
+ * cache <metadata dev> <cache dev> <origin dev> <block size>
+ *	 [<#feature args> [<arg>]*]
+ *
+ * metadata dev: fast device holding the persistent metadata
+ * cache dev: fast device holding cached data blocks
+ * origin dev: slow device holding original data blocks
+ * block size: cache unit size in sectors, a power of 2
+ *
+ * Optional feature arguments are:
+ *	     writeback: write hits only go to the cache device (default)
+ *	     writethrough: write hits go to the origin and the cache device
+ *	     promote_threshold <n>: misses before a block is promoted
+ */
+static int cache_ctr(struct dm_target *ti, unsigned argc, char **argv)
+{
+	int r;
+	struct cache *cache;
+	struct cache_features cf;
+	struct dm_arg_set as;
+	struct dm_dev *metadata_dev, *cache_dev, *origin_dev;
+	unsigned long block_size;
+	sector_t metadata_dev_size, cache_dev_size;
+	char b[BDEVNAME_SIZE];
+
+	if (argc < 4) {
+		ti->error = "Invalid argument count";
+		return -EINVAL;
+	}
+	as.argc = argc;
+	as.argv = argv;
+
+	r = dm_get_device(ti, argv[0], FMODE_READ | FMODE_WRITE, &metadata_dev);
+	if (r) {
+		ti->error = "Error opening metadata block device";
+		return r;
+	}
+
+	metadata_dev_size = i_size_read(metadata_dev->bdev->bd_inode) >> SECTOR_SHIFT;
+	if (metadata_dev_size > CACHE_METADATA_MAX_SECTORS)
+		DMWARN("Metadata device %s is larger than %u sectors: excess space will not be used.",
+		       bdevname(metadata_dev->bdev, b), CACHE_METADATA_MAX_SECTORS);
+
+	r = dm_get_device(ti, argv[1], FMODE_READ | FMODE_WRITE, &cache_dev);
+	if (r) {
+		ti->error = "Error opening cache device";
+		goto out_metadata;
+	}
+
+	r = dm_get_device(ti, argv[2], FMODE_READ | FMODE_WRITE, &origin_dev);
+	if (r) {
+		ti->error = "Error opening origin device";
+		goto out_cache;
+	}
+
+	if (ti->begin || ti->len > i_size_read(origin_dev->bdev->bd_inode) >> SECTOR_SHIFT) {
+		ti->error = "Device too small or not starting at zero";
+		r = -EINVAL;
+		goto out;
+	}
+
+	if (kstrtoul(argv[3], 10, &block_size) || !block_size ||
+	    block_size < DATA_DEV_BLOCK_SIZE_MIN_SECTORS ||
+	    block_size > DATA_DEV_BLOCK_SIZE_MAX_SECTORS ||
+	    !is_power_of_2(block_size)) {
+		ti->error = "Invalid block size";
+		r = -EINVAL;
+		goto out;
+	}
+
+	cache_dev_size = i_size_read(cache_dev->bdev->bd_inode) >> SECTOR_SHIFT;
+	cache_dev_size >>= __ffs(block_size);
+	if (!cache_dev_size || cache_dev_size > UINT_MAX) {
+		ti->error = "Invalid cache device size";
+		r = -EINVAL;
+		goto out;
+	}
+
+	cache_features_init(&cf);
+
+	dm_consume_args(&as, 4);
+	r = parse_cache_features(&as, &cf, ti);
+	if (r)
+		goto out;
+
+	cache = cache_create(ti, block_size, cache_dev_size, &ti->error);
+	if (IS_ERR(cache)) {
+		r = PTR_ERR(cache);
+		goto out;
+	}
+
+	cache->metadata_dev = metadata_dev;
+	cache->cache_dev = cache_dev;
+	cache->origin_dev = origin_dev;
+	cache->features = cf;
+	cache->suspended = true;
+
+	r = dm_set_target_max_io_len(ti, block_size);
+	if (r) {
+		ti->error = "Couldn't set max io len";
+		cache_destroy(cache);
+		goto out;
+	}
+
+	/*
+	 * Flush requests are sent to both the origin (0) and the cache
+	 * device (1).
+	 */
+	ti->num_flush_requests = 2;
+	ti->private = cache;
+
+	cache->callbacks.congested_fn = cache_is_congested;
+	dm_table_add_target_callbacks(ti->table, &cache->callbacks);
+
+	return 0;
+
+out:
+	dm_put_device(ti, origin_dev);
+out_cache:
+	dm_put_device(ti, cache_dev);
+out_metadata:
+	dm_put_device(ti, metadata_dev);
+
+	return r;
+}
+
+static void cache_dtr(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+
+	dm_put_device(ti, cache->metadata_dev);
+	dm_put_device(ti, cache->cache_dev);
+	dm_put_device(ti, cache->origin_dev);
+
+	cache_destroy(cache);
+}
+
+static int cache_map(struct dm_target *ti, struct bio *bio,
+		     union map_info *map_context)
+{
+	int r;
+	unsigned long flags;
+	struct cache *cache = ti->private;
+	struct dm_cache_endio_hook *h;
+
+	if (bio->bi_rw & REQ_FLUSH && !bio->bi_size) {
+		if (map_context->target_request_nr)
+			bio->bi_bdev = cache->cache_dev->bdev;
+		else
+			bio->bi_bdev = cache->origin_dev->bdev;
+		map_context->ptr = NULL;
+		return DM_MAPIO_REMAPPED;
+	}
+
+	h = mempool_alloc(cache->endio_hook_pool, GFP_NOIO);
+	h->cache = cache;
+	h->e = NULL;
+	h->writethrough = false;
+	h->origin_write = NULL;
+	map_context->ptr = h;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	r = __map_bio(cache, bio, h);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	return r;
+}
+
+static int cache_end_io(struct dm_target *ti, struct bio *bio, int err,
+			union map_info *map_context)
+{
+	unsigned long flags;
+	struct dm_cache_endio_hook *h = map_context->ptr;
+	struct cache *cache;
+
+	if (!h)
+		return 0;
+
+	cache = h->cache;
+
+	if (h->writethrough) {
+		h->writethrough = false;
+
+		/*
+		 * The origin wasn't updated, so the cache block must not
+		 * be either.
+		 */
+		if (!err) {
+			dm_bio_restore(&h->details, bio);
+
+			spin_lock_irqsave(&cache->lock, flags);
+			bio_list_add(&cache->writethrough_bios, bio);
+			spin_unlock_irqrestore(&cache->lock, flags);
+
+			wake_worker(cache);
+			return DM_ENDIO_INCOMPLETE;
+		}
+	}
+
+	if (h->e)
+		atomic_dec(&h->e->pending);
+
+	/* A promotion of the block may be waiting for this write */
+	if (h->origin_write && atomic_dec_and_test(h->origin_write) &&
+	    atomic_read(&cache->nr_migrations))
+		wake_worker(cache);
+
+	mempool_free(h, cache->endio_hook_pool);
+
+	return 0;
+}
+
+/*
+ * Called for every mapping that was persisted the last time the device
+ * was in use.
+ */
+static int load_mapping(void *context, dm_oblock_t oblock, dm_cblock_t cblock,
+			bool dirty)
+{
+	struct cache *cache = context;
+	struct cblock_entry *e;
+
+	if (cblock >= cache->nr_cblocks) {
+		DMERR("cache block %u out of range", cblock);
+		return -EINVAL;
+	}
+
+	e = cache->blocks + cblock;
+	e->oblock = oblock;
+	e->valid = 1;
+	e->meta_dirty = dirty;
+	if (dirty || !dm_cache_clean_when_opened(cache->cmd))
+		__set_dirty(cache, e);
+
+	__insert(cache, e);
+	list_move_tail(&e->list, &cache->lru);
+
+	return 0;
+}
+
+static int load_metadata(struct cache *cache)
+{
+	int r;
+	struct dm_cache_metadata *cmd;
+
+	cmd = dm_cache_metadata_open(cache->metadata_dev->bdev,
+				     cache->sectors_per_block,
+				     cache->nr_cblocks, true);
+	if (IS_ERR(cmd)) {
+		DMERR("couldn't open metadata device");
+		return PTR_ERR(cmd);
+	}
+
+	cache->cmd = cmd;
+
+	r = dm_cache_load_mappings(cmd, load_mapping, cache);
+	if (r) {
+		DMERR("couldn't load cache mappings");
+		return r;
+	}
+
+	/*
+	 * Mark the metadata as in use; from now on the persisted dirty
+	 * flags may be stale until the next clean shutdown.
+	 */
+	r = dm_cache_commit(cmd, false);
+	if (r) {
+		DMERR("couldn't commit cache metadata");
+		return r;
+	}
+
+	cache->loaded_mappings = true;
+
+	return 0;
+}
+
+/*
+ * Records the current dirty flags in the metadata.
+ */
+static int write_dirty_flags(struct cache *cache)
+{
+	int r;
+	dm_cblock_t i;
+
+	for (i = 0; i < cache->nr_cblocks; i++) {
+		struct cblock_entry *e = cache->blocks + i;
+
+		if (!e->valid || e->dirty == e->meta_dirty)
+			continue;
+
+		r = dm_cache_insert_mapping(cache->cmd, i, e->oblock, e->dirty);
+		if (r)
+			return r;
+
+		e->meta_dirty = e->dirty;
+	}
+
+	return 0;
+}
+
+static void cache_postsuspend(struct dm_target *ti)
+{
+	int r;
+	unsigned long flags;
+	struct cache *cache = ti->private;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	cache->suspended = true;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	cancel_delayed_work_sync(&cache->waker);
+	wait_event(cache->migration_wait, !atomic_read(&cache->nr_migrations));
+	flush_workqueue(cache->wq);
+
+	if (!cache->loaded_mappings || cache->commit_failed)
+		return;
+
+	r = write_dirty_flags(cache);
+	if (!r)
+		r = dm_cache_commit(cache->cmd, true);
+
+	if (r) {
+		DMERR("couldn't write cache metadata, error = %d", r);
+		cache->commit_failed = true;
+	}
+}
+
+static int cache_preresume(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+
+	if (cache->loaded_mappings)
+		return 0;
+
+	return load_metadata(cache);
+}
+
+static void cache_resume(struct dm_target *ti)
+{
+	unsigned long flags;
+	struct cache *cache = ti->private;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	cache->suspended = false;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	do_waker(&cache->waker.work);
+}
+
+static int cache_status(struct dm_target *ti, status_type_t type,
+			unsigned status_flags, char *result, unsigned maxlen)
+{
+	int r;
+	unsigned sz = 0;
+	unsigned long flags;
+	dm_cblock_t nr_used, nr_dirty;
+	dm_block_t nr_free_blocks_metadata, nr_blocks_metadata;
+	char buf[BDEVNAME_SIZE];
+	struct cache *cache = ti->private;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		if (!cache->cmd || cache->commit_failed) {
+			DMEMIT("Fail");
+			break;
+		}
+
+		r = dm_cache_get_free_metadata_block_count(cache->cmd,
+							   &nr_free_blocks_metadata);
+		if (r)
+			return r;
+
+		r = dm_cache_get_metadata_dev_size(cache->cmd, &nr_blocks_metadata);
+		if (r)
+			return r;
+
+		spin_lock_irqsave(&cache->lock, flags);
+		nr_used = cache->nr_cblocks;
+		if (!list_empty(&cache->free)) {
+			struct cblock_entry *e;
+
+			list_for_each_entry(e, &cache->free, list)
+				nr_used--;
+		}
+		nr_dirty = cache->nr_dirty;
+		spin_unlock_irqrestore(&cache->lock, flags);
+
+		DMEMIT("%llu/%llu %u/%u %u %u %u %u %u %u %u ",
+		       (unsigned long long)(nr_blocks_metadata - nr_free_blocks_metadata),
+		       (unsigned long long)nr_blocks_metadata,
+		       nr_used, cache->nr_cblocks,
+		       (unsigned) atomic_read(&cache->stats.read_hit),
+		       (unsigned) atomic_read(&cache->stats.read_miss),
+		       (unsigned) atomic_read(&cache->stats.write_hit),
+		       (unsigned) atomic_read(&cache->stats.write_miss),
+		       (unsigned) atomic_read(&cache->stats.promotion),
+		       (unsigned) atomic_read(&cache->stats.demotion),
+		       nr_dirty);
+
+		DMEMIT("%s", cache->features.mode == CM_WRITEBACK ?
+		       "writeback" : "writethrough");
+		break;
+
+	case STATUSTYPE_TABLE:
+		DMEMIT("%s ", format_dev_t(buf, cache->metadata_dev->bdev->bd_dev));
+		DMEMIT("%s ", format_dev_t(buf, cache->cache_dev->bdev->bd_dev));
+		DMEMIT("%s ", format_dev_t(buf, cache->origin_dev->bdev->bd_dev));
+		DMEMIT("%llu 3 %s promote_threshold %u",
+		       (unsigned long long)cache->sectors_per_block,
+		       cache->features.mode == CM_WRITEBACK ?
+		       "writeback" : "writethrough",
+		       cache->features.promote_threshold);
+		break;
+	}
+
+	return 0;
+}
+
+/*
+ * Supports:
+ *	promote_threshold <n>
+ */
+static int cache_message(struct dm_target *ti, unsigned argc, char **argv)
+{
+	unsigned threshold;
+	struct cache *cache = ti->private;
+
+	if (argc == 2 && !strcasecmp(argv[0], "promote_threshold")) {
+		if (kstrtouint(argv[1], 10, &threshold) || !threshold) {
+			DMWARN("Invalid promote_threshold: %s", argv[1]);
+			return -EINVAL;
+		}
+
+		cache->features.promote_threshold = threshold;
+		return 0;
+	}
+
+	DMWARN("Unrecognised cache target message received: %s", argv[0]);
+	return -EINVAL;
+}
+
+static sector_t get_dev_size(struct dm_dev *dev)
+{
+	return i_size_read(dev->bdev->bd_inode) >> SECTOR_SHIFT;
+}
+
+static int cache_iterate_devices(struct dm_target *ti,
+				 iterate_devices_callout_fn fn, void *data)
+{
+	int r;
+	struct cache *cache = ti->private;
+
+	r = fn(ti, cache->cache_dev, 0, get_dev_size(cache->cache_dev), data);
+	if (!r)
+		r = fn(ti, cache->origin_dev, 0, ti->len, data);
+
+	return r;
+}
+
+static void cache_io_hints(struct dm_target *ti, struct queue_limits *limits)
+{
+	struct cache *cache = ti->private;
+
+	blk_limits_io_min(limits, 0);
+	blk_limits_io_opt(limits, cache->sectors_per_block << SECTOR_SHIFT);
+}
+
+static struct target_type cache_target = {
+	.name = "cache",
+	.version = {1, 0, 0},
+	.module = THIS_MODULE,
+	.ctr = cache_ctr,
+	.dtr = cache_dtr,
+	.map = cache_map,
+	.end_io = cache_end_io,
+	.postsuspend = cache_postsuspend,
+	.preresume = cache_preresume,
+	.resume = cache_resume,
+	.status = cache_status,
+	.message = cache_message,
+	.iterate_devices = cache_iterate_devices,
+	.io_hints = cache_io_hints,
+};
+
+static int __init dm_cache_init(void)
+{
+	int r;
+
+	_endio_hook_cache = KMEM_CACHE(dm_cache_endio_hook, 0);
+	if (!_endio_hook_cache)
+		return -ENOMEM;
+
+	r = dm_register_target(&cache_target);
+	if (r) {
+		DMERR("cache target registration failed: %d", r);
+		kmem_cache_destroy(_endio_hook_cache);
+	}
+
+	return r;
+}
+
+static void __exit dm_cache_exit(void)
+{
+	dm_unregister_target(&cache_target);
+	kmem_cache_destroy(_endio_hook_cache);
+}
+
+module_init(dm_cache_init);
+module_exit(dm_cache_exit);
+
+MODULE_DESCRIPTION(DM_NAME " cache target");
+MODULE_LICENSE("GPL");
@@ -46,6 +46,8 @@ void inc_children(struct dm_transaction_manager *tm, struct node *n,
 		  struct dm_btree_value_type *vt);
 
 int new_block(struct dm_btree_info *info, struct dm_block **result);
+int bn_read_lock(struct dm_btree_info *info, dm_block_t b,
+		 struct dm_block **result);
 int unlock_block(struct dm_btree_info *info, struct dm_block *b);
 
 /*
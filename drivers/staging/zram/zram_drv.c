@@ -26,12 +26,14 @@
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -104,6 +106,109 @@ static int page_zero_filled(void *ptr)
 	return 1;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_reset_bdev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bitmap);
+
+	zram->backing_dev = NULL;
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	struct file *backing_dev;
+	struct inode *inode;
+	struct block_device *bdev;
+	unsigned long nr_pages, *bitmap;
+
+	backing_dev = filp_open(path, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev))
+		return PTR_ERR(backing_dev);
+
+	inode = backing_dev->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		ret = -ENOTBLK;
+		goto out_fput;
+	}
+
+	/* blkdev_get() drops the reference on failure */
+	bdev = bdgrab(I_BDEV(inode));
+	ret = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (ret < 0)
+		goto out_fput;
+
+	/* Block 0 is never used, a zero handle means "no data" */
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		ret = -EINVAL;
+		goto out_put;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	down_write(&zram->init_lock);
+	if (zram->init_done || zram->backing_dev) {
+		up_write(&zram->init_lock);
+		vfree(bitmap);
+		ret = -EBUSY;
+		goto out_put;
+	}
+
+	zram->backing_dev = backing_dev;
+	zram->bdev = bdev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("Using %s as backing device (%lu pages)\n", path, nr_pages);
+	return 0;
+
+out_put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_fput:
+	filp_close(backing_dev, NULL);
+	return ret;
+}
+
+static unsigned long zram_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bitmap_lock);
+	blk = find_next_zero_bit(zram->bitmap, zram->nr_pages, 1);
+	if (blk < zram->nr_pages)
+		__set_bit(blk, zram->bitmap);
+	else
+		blk = 0;
+	spin_unlock(&zram->bitmap_lock);
+
+	return blk;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bitmap_lock);
+	WARN_ON_ONCE(!test_bit(blk, zram->bitmap));
+	__clear_bit(blk, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+}
+#else
+static inline void zram_reset_bdev(struct zram *zram) { }
+#endif
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -138,6 +243,21 @@ static void zram_free_page(struct zram *zram, size_t index)
 	unsigned long handle = zram->table[index].handle;
 	u16 size = zram->table[index].size;
 
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_free_block(zram, handle);
+		zram_stat64_sub(zram, &zram->stats.bd_count, 1);
+
+		zram->table[index].handle = 0;
+		zram->table[index].size = 0;
+		return;
+	}
+#endif
+
 	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
@@ -183,6 +303,134 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int zram_bdev_rw_page(struct zram *zram, struct page *page,
+			     unsigned long blk, int rw)
+{
+	int ret = 0;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	if (bio_add_page(bio, page, PAGE_SIZE, 0) != PAGE_SIZE) {
+		bio_put(bio);
+		return -EIO;
+	}
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+
+	submit_bio(rw | REQ_SYNC, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	if (rw == READ)
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+	else
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+
+	return ret;
+}
+
+struct zram_bdev_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_work *w =
+		container_of(work, struct zram_bdev_work, work);
+
+	w->ret = zram_bdev_rw_page(w->zram, w->page, w->blk, READ);
+}
+
+/*
+ * Reads are issued from within zram_make_request(), where bios submitted
+ * to another device are only dispatched once we return. Hand the I/O to
+ * a worker and wait for it there.
+ */
+static int zram_read_from_bdev(struct zram *zram, struct page *page,
+			       unsigned long blk)
+{
+	struct zram_bdev_work w;
+
+	w.zram = zram;
+	w.page = page;
+	w.blk = blk;
+
+	INIT_WORK_ONSTACK(&w.work, zram_bdev_read_work);
+	queue_work(system_unbound_wq, &w.work);
+	flush_work(&w.work);
+	destroy_work_on_stack(&w.work);
+
+	return w.ret;
+}
+
+static int zram_bvec_read_bdev(struct zram *zram, struct bio_vec *bvec,
+			       u32 index, int offset)
+{
+	int ret;
+	struct page *page;
+	unsigned char *user_mem, *mem;
+	unsigned long blk = zram->table[index].handle;
+
+	if (!is_partial_io(bvec))
+		return zram_read_from_bdev(zram, bvec->bv_page, blk);
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_read_from_bdev(zram, page, blk);
+	if (!ret) {
+		mem = kmap_atomic(page);
+		user_mem = kmap_atomic(bvec->bv_page);
+		memcpy(user_mem + bvec->bv_offset, mem + offset,
+		       bvec->bv_len);
+		kunmap_atomic(user_mem);
+		kunmap_atomic(mem);
+	}
+	__free_page(page);
+
+	return ret;
+}
+
+static int zram_read_before_write_bdev(struct zram *zram, char *mem,
+				       u32 index)
+{
+	int ret;
+	struct page *page;
+	void *src;
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_read_from_bdev(zram, page, zram->table[index].handle);
+	if (!ret) {
+		src = kmap_atomic(page);
+		memcpy(mem, src, PAGE_SIZE);
+		kunmap_atomic(src);
+	}
+	__free_page(page);
+
+	return ret;
+}
+#endif
+
 static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
@@ -206,6 +454,21 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 		return 0;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		ret = zram_bvec_read_bdev(zram, bvec, index, offset);
+		if (unlikely(ret)) {
+			pr_err("Backing device read failed! err=%d, page=%u\n",
+			       ret, index);
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+			return ret;
+		}
+		flush_dcache_page(page);
+		return 0;
+	}
+#endif
+
 	if (is_partial_io(bvec)) {
 		/* Use  a temporary buffer to decompress the page */
 		uncmem = kmalloc(PAGE_SIZE, GFP_KERNEL);
@@ -264,9 +527,26 @@ static int zram_read_before_write(struct zram *zram, char *mem, u32 index)
 		return 0;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		ret = zram_read_before_write_bdev(zram, mem, index);
+		if (unlikely(ret)) {
+			pr_err("Backing device read failed! err=%d, page=%u\n",
+			       ret, index);
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+		}
+		return ret;
+	}
+#endif
+
 	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
-	ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
-				    mem, &clen);
+	if (zram->table[index].size == PAGE_SIZE) {
+		memcpy(mem, cmem, PAGE_SIZE);
+		ret = LZO_E_OK;
+	} else {
+		ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
+					    mem, &clen);
+	}
 	zs_unmap_object(zram->mem_pool, handle);
 
 	/* Should NEVER happen. Return bio error if it does. */
@@ -401,6 +681,114 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+void zram_mark_idle(struct zram *zram)
+{
+	u32 index;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done)
+		goto out;
+
+	down_write(&zram->lock);
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		if (zram->table[index].handle &&
+		    !zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+	}
+	up_write(&zram->lock);
+out:
+	up_read(&zram->init_lock);
+}
+
+static bool zram_wb_candidate(struct zram *zram, u32 index,
+			      enum zram_wb_mode mode)
+{
+	if (!zram->table[index].handle ||
+	    zram_test_flag(zram, index, ZRAM_WB) ||
+	    zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return false;
+
+	if (mode == ZRAM_WB_HUGE)
+		return zram->table[index].size == PAGE_SIZE;
+
+	return zram_test_flag(zram, index, ZRAM_IDLE);
+}
+
+/*
+ * Move every slot selected by @mode out to the backing device. The page
+ * is written without holding zram->lock; the slot is only switched over
+ * if nobody rewrote or freed it meanwhile, which clears ZRAM_UNDER_WB.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0;
+	u32 index;
+	unsigned long blk;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	down_read(&zram->init_lock);
+	if (!zram->init_done || !zram->backing_dev) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	mutex_lock(&zram->wb_lock);
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		down_write(&zram->lock);
+		if (!zram_wb_candidate(zram, index, mode)) {
+			up_write(&zram->lock);
+			continue;
+		}
+
+		blk = zram_alloc_block(zram);
+		if (!blk) {
+			up_write(&zram->lock);
+			ret = -ENOSPC;
+			break;
+		}
+
+		ret = zram_read_before_write(zram, page_address(page), index);
+		if (ret) {
+			up_write(&zram->lock);
+			zram_free_block(zram, blk);
+			break;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		up_write(&zram->lock);
+
+		ret = zram_bdev_rw_page(zram, page, blk, WRITE);
+
+		down_write(&zram->lock);
+		if (!ret && zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_free_page(zram, index);
+			zram_set_flag(zram, index, ZRAM_WB);
+			zram->table[index].handle = blk;
+			zram_stat64_inc(zram, &zram->stats.bd_count);
+			blk = 0;
+		} else {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		}
+		up_write(&zram->lock);
+
+		if (blk)
+			zram_free_block(zram, blk);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&zram->wb_lock);
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+
+	return ret;
+}
+#endif
+
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 {
 	if (*offset + bvec->bv_len >= PAGE_SIZE)
@@ -526,7 +914,7 @@ void __zram_reset_device(struct zram *zram)
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		unsigned long handle = zram->table[index].handle;
-		if (!handle)
+		if (!handle || zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		zs_free(zram->mem_pool, handle);
@@ -538,6 +926,8 @@ void __zram_reset_device(struct zram *zram)
 	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+	zram_reset_bdev(zram);
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -638,6 +1028,10 @@ static int create_device(struct zram *zram, int device_id)
 	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+	mutex_init(&zram->wb_lock);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -774,6 +1168,7 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+		zram_reset_bdev(zram);
 	}
 
 	unregister_blkdev(zram_major, "zram");
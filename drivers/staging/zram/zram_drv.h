@@ -58,6 +58,12 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
+	/* Page was not accessed since the last 'idle' marking */
+	ZRAM_IDLE,
+	/* Page lives on the backing device, handle is the block index */
+	ZRAM_WB,
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -84,6 +90,17 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 bad_compress;	/* % of pages with compression ratio>=75% */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	u64 bd_count;		/* no. of pages on the backing device */
+	u64 bd_reads;		/* no. of reads from the backing device */
+	u64 bd_writes;		/* no. of writes to the backing device */
+#endif
+};
+
+/* Which slots 'writeback' pushes out to the backing device */
+enum zram_wb_mode {
+	ZRAM_WB_HUGE,		/* stored uncompressed */
+	ZRAM_WB_IDLE,		/* not accessed since the last idle marking */
 };
 
 struct zram {
@@ -106,6 +123,19 @@ struct zram {
 	u64 disksize;	/* bytes */
 
 	struct zram_stats stats;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/*
+	 * Optional block device that incompressible and idle pages are
+	 * written out to. Set up through sysfs before initialization.
+	 */
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned long nr_pages;	/* size of the backing device in pages */
+	unsigned long *bitmap;	/* blocks in use on the backing device */
+	spinlock_t bitmap_lock;
+	/* Serializes writeback runs against each other */
+	struct mutex wb_lock;
+#endif
 };
 
 extern struct zram *zram_devices;
@@ -117,4 +147,10 @@ extern struct attribute_group zram_disk_attr_group;
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
+
 #endif
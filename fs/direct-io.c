@@ -131,6 +131,11 @@ struct dio {
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
 
+	/* Polled completion of sync IO */
+	struct request_queue *poll_queue; /* NULL unless polling */
+	struct bio *poll_bio;		/* first bio until it completes */
+	u64 poll_start;			/* ktime of first bio submission */
+
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
 	ssize_t result;                 /* IO result */
@@ -306,6 +311,13 @@ static void dio_bio_end_io(struct bio *bio, int error)
 	struct dio *dio = bio->bi_private;
 	unsigned long flags;
 
+	/* Only the first bio is timed, the others queued up behind it */
+	if (bio == dio->poll_bio) {
+		blk_poll_account(dio->poll_queue,
+				 ktime_to_ns(ktime_get()) - dio->poll_start);
+		dio->poll_bio = NULL;
+	}
+
 	spin_lock_irqsave(&dio->bio_lock, flags);
 	bio->bi_private = dio->bio_list;
 	dio->bio_list = bio;
@@ -379,6 +391,11 @@ static inline void dio_bio_submit(struct dio *dio, struct dio_submit *sdio)
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
 
+	if (dio->poll_queue && !dio->poll_start) {
+		dio->poll_bio = bio;
+		dio->poll_start = ktime_to_ns(ktime_get());
+	}
+
 	if (sdio->submit_io)
 		sdio->submit_io(dio->rw, bio, dio->inode,
 			       sdio->logical_offset_in_bio);
@@ -399,6 +416,23 @@ static inline void dio_cleanup(struct dio *dio, struct dio_submit *sdio)
 		page_cache_release(dio_get_page(dio, sdio));
 }
 
+/*
+ * How long to sleep before polling for the completion of the first bio
+ * submitted, if at all.  Once that is overdue, the others are polled
+ * for right away.
+ */
+static bool dio_poll_delay(struct dio *dio, ktime_t *kt)
+{
+	u64 delay = blk_poll_sleep_nsecs(dio->poll_queue);
+	u64 elapsed = ktime_to_ns(ktime_get()) - dio->poll_start;
+
+	if (delay <= elapsed)
+		return false;
+
+	*kt = ns_to_ktime(delay - elapsed);
+	return true;
+}
+
 /*
  * Wait for the next BIO to complete.  Remove it and return it.  NULL is
  * returned once all BIOs have been completed.  This must only be called once
@@ -409,6 +443,8 @@ static struct bio *dio_await_one(struct dio *dio)
 {
 	unsigned long flags;
 	struct bio *bio = NULL;
+	bool slept = false;
+	ktime_t kt;
 
 	spin_lock_irqsave(&dio->bio_lock, flags);
 
@@ -419,6 +455,30 @@ static struct bio *dio_await_one(struct dio *dio)
 	 * and can call it after testing our condition.
 	 */
 	while (dio->refcount > 1 && dio->bio_list == NULL) {
+		/*
+		 * On a polled queue sleep for part of the expected completion
+		 * time, then spin on the driver until the bio completes or
+		 * someone else needs the CPU.
+		 */
+		if (dio->poll_queue && blk_queue_io_poll(dio->poll_queue) &&
+		    !need_resched()) {
+			if (!slept && dio_poll_delay(dio, &kt)) {
+				__set_current_state(TASK_UNINTERRUPTIBLE);
+				dio->waiter = current;
+				spin_unlock_irqrestore(&dio->bio_lock, flags);
+				schedule_hrtimeout(&kt, HRTIMER_MODE_REL);
+				spin_lock_irqsave(&dio->bio_lock, flags);
+				dio->waiter = NULL;
+			} else {
+				spin_unlock_irqrestore(&dio->bio_lock, flags);
+				if (!blk_poll(dio->poll_queue))
+					cpu_relax();
+				spin_lock_irqsave(&dio->bio_lock, flags);
+			}
+			slept = true;
+			continue;
+		}
+
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
@@ -1148,6 +1208,13 @@ do_blockdev_direct_IO(int rw, struct kiocb *iocb, struct inode *inode,
 
 	dio->inode = inode;
 	dio->rw = rw;
+
+	if (!dio->is_async) {
+		struct request_queue *q = bdev_get_queue(bdev);
+
+		if (q && q->poll_fn && blk_queue_io_poll(q))
+			dio->poll_queue = q;
+	}
 	sdio.blkbits = blkbits;
 	sdio.blkfactor = inode->i_blkbits - blkbits;
 	sdio.block_in_file = offset >> blkbits;
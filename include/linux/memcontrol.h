@@ -179,7 +179,11 @@ static inline void mem_cgroup_dec_page_stat(struct page *page,
 
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask,
+						unsigned long nr_to_reclaim,
 						unsigned long *total_scanned);
+void mem_cgroup_account_reclaim(struct mem_cgroup *memcg,
+				unsigned long nr_scanned,
+				unsigned long nr_reclaimed, bool soft);
 
 void mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
@@ -357,11 +361,19 @@ static inline void mem_cgroup_dec_page_stat(struct page *page,
 static inline
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 					    gfp_t gfp_mask,
+					    unsigned long nr_to_reclaim,
 					    unsigned long *total_scanned)
 {
 	return 0;
 }
 
+static inline void mem_cgroup_account_reclaim(struct mem_cgroup *memcg,
+					      unsigned long nr_scanned,
+					      unsigned long nr_reclaimed,
+					      bool soft)
+{
+}
+
 static inline void mem_cgroup_split_huge_fixup(struct page *head)
 {
 }
@@ -0,0 +1,25 @@
+#ifndef _LINUX_PREZERO_H
+#define _LINUX_PREZERO_H
+
+#include <linux/mm_types.h>
+
+/*
+ * Per-cpu pools of pages zeroed ahead of time by kprezerod, so that the
+ * page fault path does not have to clear them.
+ */
+enum prezero_type {
+	PREZERO_MOVABLE,	/* anonymous user pages */
+	PREZERO_KERNEL,		/* lowmem, unmovable: page tables */
+	NR_PREZERO_TYPES
+};
+
+#ifdef CONFIG_PREZERO_PAGES
+extern struct page *prezero_page_get(enum prezero_type type);
+#else
+static inline struct page *prezero_page_get(enum prezero_type type)
+{
+	return NULL;
+}
+#endif
+
+#endif /* _LINUX_PREZERO_H */
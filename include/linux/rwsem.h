@@ -18,6 +18,14 @@
 
 struct rw_semaphore;
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * ->owner of an rwsem held for reading.  The readers themselves are not
+ * tracked, so a writer does not spin waiting for them.
+ */
+#define RWSEM_READER_OWNED	((struct task_struct *)1UL)
+#endif
+
 #ifdef CONFIG_RWSEM_GENERIC_SPINLOCK
 #include <linux/rwsem-spinlock.h> /* use a generic implementation */
 #else
@@ -26,6 +34,9 @@ struct rw_semaphore {
 	long			count;
 	raw_spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	struct task_struct	*owner;
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
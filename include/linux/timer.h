@@ -22,6 +22,7 @@ struct timer_list {
 	unsigned long data;
 
 	int slack;
+	unsigned int idx;
 
 #ifdef CONFIG_TIMER_STATS
 	int start_pid;
@@ -11,6 +11,7 @@
 #include <linux/lockdep.h>
 #include <linux/threads.h>
 #include <linux/atomic.h>
+#include <linux/cpumask.h>
 
 struct workqueue_struct;
 
@@ -254,9 +255,10 @@ enum {
 	WQ_MEM_RECLAIM		= 1 << 3, /* may be used for memory reclaim */
 	WQ_HIGHPRI		= 1 << 4, /* high priority */
 	WQ_CPU_INTENSIVE	= 1 << 5, /* cpu instensive workqueue */
+	WQ_SYSFS		= 1 << 6, /* visible in sysfs */
 
-	WQ_DRAINING		= 1 << 6, /* internal: workqueue is draining */
-	WQ_RESCUER		= 1 << 7, /* internal: workqueue has rescuer */
+	WQ_DRAINING		= 1 << 7, /* internal: workqueue is draining */
+	WQ_RESCUER		= 1 << 8, /* internal: workqueue has rescuer */
 
 	WQ_MAX_ACTIVE		= 512,	  /* I like 512, better ideas? */
 	WQ_MAX_UNBOUND_PER_CPU	= 4,	  /* 4 * #cpus for unbound wq */
@@ -267,6 +269,22 @@ enum {
 #define WQ_UNBOUND_MAX_ACTIVE	\
 	max_t(int, WQ_MAX_ACTIVE, num_possible_cpus() * WQ_MAX_UNBOUND_PER_CPU)
 
+/**
+ * struct workqueue_attrs - attributes of the workers of an unbound workqueue
+ * @nice: nice level of the workers
+ * @node: NUMA node the workers are allocated on and confined to, or
+ *	  NUMA_NO_NODE
+ * @cpumask: CPUs the workers are allowed to run on
+ *
+ * Unbound workqueues with the same attributes share their workers.
+ * Attributes are changed with apply_workqueue_attrs().
+ */
+struct workqueue_attrs {
+	int			nice;
+	int			node;
+	cpumask_var_t		cpumask;
+};
+
 /*
  * System-wide workqueues which are always present.
  *
@@ -395,6 +413,11 @@ extern bool flush_delayed_work(struct delayed_work *dwork);
 extern bool flush_delayed_work_sync(struct delayed_work *work);
 extern bool cancel_delayed_work_sync(struct delayed_work *dwork);
 
+extern struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask);
+extern void free_workqueue_attrs(struct workqueue_attrs *attrs);
+extern int apply_workqueue_attrs(struct workqueue_struct *wq,
+				 const struct workqueue_attrs *attrs);
+
 extern void workqueue_set_max_active(struct workqueue_struct *wq,
 				     int max_active);
 extern bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq);
@@ -182,6 +182,40 @@ TRACE_EVENT(sched_migrate_task,
 		  __entry->orig_cpu, __entry->dest_cpu)
 );
 
+/*
+ * Tracepoint for a wakeup moved to a more powerful cpu because the task
+ * does not fit on the one it was going to:
+ */
+TRACE_EVENT(sched_capacity_fit,
+
+	TP_PROTO(struct task_struct *p, unsigned long util, int target_cpu,
+		 int dest_cpu, unsigned long dest_power),
+
+	TP_ARGS(p, util, target_cpu, dest_cpu, dest_power),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	unsigned long,	util		)
+		__field(	int,	target_cpu		)
+		__field(	int,	dest_cpu		)
+		__field(	unsigned long,	dest_power	)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->util		= util;
+		__entry->target_cpu	= target_cpu;
+		__entry->dest_cpu	= dest_cpu;
+		__entry->dest_power	= dest_power;
+	),
+
+	TP_printk("comm=%s pid=%d util=%lu target_cpu=%d dest_cpu=%d dest_power=%lu",
+		  __entry->comm, __entry->pid, __entry->util,
+		  __entry->target_cpu, __entry->dest_cpu, __entry->dest_power)
+);
+
 DECLARE_EVENT_CLASS(sched_process_template,
 
 	TP_PROTO(struct task_struct *p),
@@ -8,6 +8,7 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
 #include <trace/events/timer.h>
 
 /*
@@ -581,6 +582,9 @@ static void arm_timer(struct k_itimer *timer)
 			break;
 		}
 	}
+
+	/* The full dynticks cpus need their tick to fire the timer */
+	tick_nohz_full_kick_all();
 }
 
 /*
@@ -1031,6 +1035,23 @@ static inline int task_cputime_zero(const struct task_cputime *cputime)
 	return 0;
 }
 
+/**
+ * posix_cpu_timers_can_stop_tick - check whether a task needs the tick
+ * @tsk: task running on a cpu which wants to stop its tick
+ *
+ * The CPU timers of @tsk and of its thread group are run from the tick.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+
 /*
  * Check for any per-thread CPU timers that have fired and move them
  * off the tsk->*_timers list onto the firing list.  Per-thread timers
@@ -1389,6 +1410,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	tick_nohz_full_kick_all();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
@@ -1333,6 +1333,21 @@ static void rcu_torture_shuffle_tasks(void)
 	if (stats_task)
 		set_cpus_allowed_ptr(stats_task, shuffle_tmp_mask);
 
+	/*
+	 * Moving the barrier tasks around has them post their callbacks
+	 * from both normal and no-CBs CPUs, so that rcu_barrier() is
+	 * checked against the callbacks of offloaded CPUs as well.
+	 */
+	if (barrier_cbs_tasks) {
+		for (i = 0; i < n_barrier_cbs; i++)
+			if (barrier_cbs_tasks[i])
+				set_cpus_allowed_ptr(barrier_cbs_tasks[i],
+						     shuffle_tmp_mask);
+	}
+
+	if (barrier_task)
+		set_cpus_allowed_ptr(barrier_task, shuffle_tmp_mask);
+
 	if (rcu_idle_cpu == -1)
 		rcu_idle_cpu = num_online_cpus() - 1;
 	else
@@ -52,6 +52,7 @@
 #include <linux/prefetch.h>
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -62,7 +63,7 @@
 
 static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 
-#define RCU_STATE_INITIALIZER(sname, cr) { \
+#define RCU_STATE_INITIALIZER(sname, sabbr, cr) { \
 	.level = { &sname##_state.node[0] }, \
 	.call = cr, \
 	.fqs_state = RCU_GP_IDLE, \
@@ -74,13 +75,15 @@ static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 	.barrier_mutex = __MUTEX_INITIALIZER(sname##_state.barrier_mutex), \
 	.fqslock = __RAW_SPIN_LOCK_UNLOCKED(&sname##_state.fqslock), \
 	.name = #sname, \
+	.abbr = sabbr, \
 }
 
 struct rcu_state rcu_sched_state =
-	RCU_STATE_INITIALIZER(rcu_sched, call_rcu_sched);
+	RCU_STATE_INITIALIZER(rcu_sched, 's', call_rcu_sched);
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, call_rcu_bh);
+struct rcu_state rcu_bh_state =
+	RCU_STATE_INITIALIZER(rcu_bh, 'b', call_rcu_bh);
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -699,6 +702,14 @@ static int rcu_implicit_dynticks_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
+	/*
+	 * A busy full dynticks CPU with its tick stopped neither notices
+	 * the grace period nor reports quiescent states: kick it so that
+	 * it brings its tick back until it has done so.
+	 */
+	if (tick_nohz_full_cpu(rdp->cpu) && cpu_online(rdp->cpu))
+		tick_nohz_full_kick_cpu(rdp->cpu);
+
 	/* Go check for the CPU being offline. */
 	return rcu_implicit_offline_qs(rdp);
 }
@@ -1831,6 +1842,9 @@ __rcu_process_callbacks(struct rcu_state *rsp)
 	/* If there are callbacks ready, invoke them. */
 	if (cpu_has_callbacks_ready_to_invoke(rdp))
 		invoke_rcu_callbacks(rsp, rdp);
+
+	/* Do any needed deferred wakeups of rcuo kthreads. */
+	do_nocb_deferred_wakeup(rdp);
 }
 
 /*
@@ -1919,9 +1933,16 @@ static void __call_rcu_core(struct rcu_state *rsp, struct rcu_data *rdp,
 		force_quiescent_state(rsp, 1);
 }
 
+/*
+ * Queue a callback on the current CPU.  If that CPU is a no-CBs CPU
+ * and offloading is allowed, the callback is handed to the CPU's rcuo
+ * kthread, otherwise it goes on the CPU's own list and is invoked from
+ * RCU_SOFTIRQ.  The rcuo kthreads themselves wait for grace periods
+ * by way of the CPU's own list, which is what the nocb argument is for.
+ */
 static void
-__call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp, bool lazy)
+___call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
+	    struct rcu_state *rsp, bool lazy, bool nocb)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1942,6 +1963,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* Hand the callback off to the rcuo kthread of a no-CBs CPU. */
+	if (nocb && __call_rcu_nocb(rdp, head, lazy, flags)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	ACCESS_ONCE(rdp->qlen)++;
 	if (lazy)
@@ -1960,9 +1987,20 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 
 	/* Go handle any RCU core processing required. */
 	__call_rcu_core(rsp, rdp, head, flags);
+
+	/* The callback needs the tick to advance on a full dynticks CPU. */
+	if (tick_nohz_full_cpu(smp_processor_id()))
+		tick_nohz_full_kick_cpu(smp_processor_id());
 	local_irq_restore(flags);
 }
 
+static void
+__call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
+	   struct rcu_state *rsp, bool lazy)
+{
+	___call_rcu(head, func, rsp, lazy, true);
+}
+
 /*
  * Queue an RCU-sched callback for invocation after a grace period.
  */
@@ -2244,6 +2282,10 @@ static int __rcu_pending(struct rcu_state *rsp, struct rcu_data *rdp)
 		return 1;
 	}
 
+	/* Does this CPU owe an rcuo kthread a wakeup? */
+	if (rcu_nocb_need_deferred_wakeup(rdp))
+		return 1;
+
 	/* nothing to do */
 	rdp->n_rp_need_nothing++;
 	return 0;
@@ -2272,13 +2314,41 @@ static int rcu_pending(int cpu)
 static int rcu_cpu_has_callbacks(int cpu)
 {
 	struct rcu_state *rsp;
+	struct rcu_data *rdp;
 
-	/* RCU callbacks either ready or pending? */
-	for_each_rcu_flavor(rsp)
-		if (per_cpu_ptr(rsp->rda, cpu)->nxtlist)
+	/* RCU callbacks either ready or pending, or rcuo wakeup owed? */
+	for_each_rcu_flavor(rsp) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (rdp->nxtlist || rcu_nocb_need_deferred_wakeup(rdp))
+			return 1;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Check to see if the specified full dynticks CPU, about to run a task
+ * with its scheduling-clock tick stopped, still owes the current grace
+ * period a quiescent state or has callbacks queued, returning 1 if so.
+ * Either way it needs the tick, which is where it reports quiescent
+ * states and advances its callbacks.
+ */
+int rcu_nohz_full_needs_cpu(int cpu)
+{
+	struct rcu_state *rsp;
+	struct rcu_data *rdp;
+
+	if (rcu_cpu_has_callbacks(cpu))
+		return 1;
+
+	for_each_rcu_flavor(rsp) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		if (ACCESS_ONCE(rdp->mynode->qsmask) & rdp->grpmask)
 			return 1;
+	}
 	return 0;
 }
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
 
 /*
  * Helper function for _rcu_barrier() tracing.  If tracing is disabled,
@@ -2399,12 +2469,19 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	 * that will tell us when all the preceding callbacks have
 	 * been invoked.  If an offline CPU has callbacks, wait for
 	 * it to either come back online or to finish orphaning those
-	 * callbacks.
+	 * callbacks.  The callbacks of no-CBs CPUs are invoked in
+	 * order by their rcuo kthread whether or not the CPU is
+	 * online, so queue the new callback directly behind them.
 	 */
 	for_each_possible_cpu(cpu) {
 		preempt_disable();
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (cpu_is_offline(cpu)) {
+		if (is_nocb_cpu(cpu)) {
+			_rcu_barrier_trace(rsp, "NoCB", cpu,
+					   rsp->n_barrier_done);
+			preempt_enable();
+			rcu_nocb_barrier(rdp);
+		} else if (cpu_is_offline(cpu)) {
 			_rcu_barrier_trace(rsp, "Offline", cpu,
 					   rsp->n_barrier_done);
 			preempt_enable();
@@ -2501,6 +2578,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -2804,6 +2882,7 @@ void __init rcu_init(void)
 	int cpu;
 
 	rcu_bootup_announce();
+	rcu_init_nocb();
 	rcu_init_geometry();
 	rcu_init_one(&rcu_sched_state, &rcu_sched_data);
 	rcu_init_one(&rcu_bh_state, &rcu_bh_data);
@@ -25,6 +25,7 @@
  */
 
 #include <linux/delay.h>
+#include <linux/bootmem.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -79,7 +80,7 @@ static void __init rcu_bootup_announce_oddness(void)
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
 struct rcu_state rcu_preempt_state =
-	RCU_STATE_INITIALIZER(rcu_preempt, call_rcu);
+	RCU_STATE_INITIALIZER(rcu_preempt, 'p', call_rcu);
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -1820,11 +1821,13 @@ extern int tick_nohz_enabled;
 /*
  * Does the specified flavor of RCU have non-lazy callbacks pending on
  * the specified CPU?  Both RCU flavor and CPU are specified by the
- * rcu_data structure.
+ * rcu_data structure.  A deferred wakeup of an rcuo kthread counts as
+ * such a callback, as it has to be done soon by RCU_SOFTIRQ.
  */
 static bool __rcu_cpu_has_nonlazy_callbacks(struct rcu_data *rdp)
 {
-	return rdp->qlen != rdp->qlen_lazy;
+	return rdp->qlen != rdp->qlen_lazy ||
+	       rcu_nocb_need_deferred_wakeup(rdp);
 }
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
@@ -2227,3 +2230,336 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set, there is a
+ * kthread for each flavor of RCU ("rcuos/N" for RCU-sched, "rcuob/N"
+ * for RCU-bh and "rcuop/N" for preemptible RCU) that takes the CPU's
+ * callbacks, waits for a grace period, and invokes them.  These kthreads
+ * are not bound to their CPU: they start out on the CPUs that are not
+ * offloaded and can be affined anywhere, so that the softirq latency
+ * of callback bursts moves off the offloaded CPUs.
+ *
+ * The callbacks are queued on a lockless list, ->nocb_head, whose tail
+ * is advanced with xchg().  The kthread takes the whole list at once,
+ * waits for a grace period by posting a callback of its own on the list
+ * of the CPU it runs on (bypassing offloading), and invokes the batch.
+ */
+
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static bool rcu_nocb_poll;	    /* Offload kthreads are to poll. */
+module_param(rcu_nocb_poll, bool, 0444);
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Enqueue the specified callback onto the no-CBs list of the CPU
+ * corresponding to rdp, which need not be the current CPU, and awaken
+ * the CPU's rcuo kthread if the list was empty.  If the caller holds
+ * scheduler locks, as it might if it runs with interrupts disabled,
+ * the wakeup could deadlock, so it is instead deferred to the next
+ * invocation of the RCU core on this CPU when defer is set.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp, bool lazy, bool defer)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	old_rhpp = xchg(&rdp->nocb_tail, &rhp->next);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_inc(&rdp->nocb_q_count);
+	if (lazy)
+		atomic_long_inc(&rdp->nocb_q_count_lazy);
+
+	/* If we are not being polled and there is a kthread, awaken it. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (rcu_nocb_poll || !t || old_rhpp != &rdp->nocb_head)
+		return;
+	if (!defer) {
+		wake_up(&rdp->nocb_wq);
+		return;
+	}
+	ACCESS_ONCE(rdp->nocb_defer_wakeup) = true;
+
+	/* A full dynticks CPU needs its tick back to do the wakeup. */
+	if (tick_nohz_full_cpu(rdp->cpu))
+		tick_nohz_full_kick_cpu(rdp->cpu);
+}
+
+/*
+ * This is a helper for __call_rcu(), which invokes it with interrupts
+ * disabled.  If this is not a no-CBs CPU, return false so that the
+ * callback goes on the CPU's own list.  Otherwise, queue the callback
+ * where the corresponding "rcuo" kthread can find it.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp, lazy, irqs_disabled_flags(flags));
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return true;
+}
+
+/*
+ * Post an rcu_barrier_callback() on the no-CBs list of the CPU
+ * corresponding to rdp.  The rcuo kthread invokes the callbacks of
+ * that list in order, so this one is invoked after all earlier ones.
+ * Called by _rcu_barrier() from any CPU, so the wakeup is never
+ * deferred.
+ */
+static void rcu_nocb_barrier(struct rcu_data *rdp)
+{
+	struct rcu_head *rhp = &rdp->barrier_head;
+
+	debug_rcu_head_queue(rhp);
+	rhp->func = rcu_barrier_callback;
+	rhp->next = NULL;
+	atomic_inc(&rdp->rsp->barrier_cpu_count);
+	smp_mb__after_atomic_inc(); /* Count before adding callback. */
+	__call_rcu_nocb_enqueue(rdp, rhp, false, false);
+}
+
+/* Grace-period waiter for the rcuo kthreads. */
+struct rcu_nocb_gp_wait {
+	struct rcu_head head;
+	struct completion done;
+};
+
+static void rcu_nocb_gp_done(struct rcu_head *rhp)
+{
+	struct rcu_nocb_gp_wait *w;
+
+	w = container_of(rhp, struct rcu_nocb_gp_wait, head);
+	complete(&w->done);
+}
+
+/*
+ * Wait for a grace period of the flavor of RCU of the specified rcu_data
+ * structure.  The callback goes on the normal list of whatever CPU we
+ * happen to be running on, even a no-CBs CPU: queueing it for an rcuo
+ * kthread could have it wait on itself.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_nocb_gp_wait w;
+
+	init_rcu_head_on_stack(&w.head);
+	init_completion(&w.done);
+	___call_rcu(&w.head, rcu_nocb_gp_done, rdp->rsp, false, false);
+	wait_for_completion(&w.done);
+	destroy_rcu_head_on_stack(&w.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	long c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* If not polling, wait for next batch of callbacks. */
+		if (!rcu_nocb_poll)
+			wait_event_interruptible(rdp->nocb_wq,
+						 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			schedule_timeout_interruptible(1);
+			flush_signals(current);
+			continue;
+		}
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_nocbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Is a deferred wakeup of rcu_nocb_kthread() required? */
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
+{
+	return ACCESS_ONCE(rdp->nocb_defer_wakeup);
+}
+
+/* Do a deferred wakeup of rcu_nocb_kthread(). */
+static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
+{
+	if (!rcu_nocb_need_deferred_wakeup(rdp))
+		return;
+	ACCESS_ONCE(rdp->nocb_defer_wakeup) = false;
+	wake_up(&rdp->nocb_wq);
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/*
+ * Set up the mask of no-CBs CPUs.  Full dynticks CPUs are always
+ * offloaded, as their callbacks would otherwise keep the tick going.
+ */
+static void __init rcu_init_nocb(void)
+{
+	char buf[80];
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running) {
+		if (!have_rcu_nocb_mask) {
+			zalloc_cpumask_var(&rcu_nocb_mask, GFP_NOWAIT);
+			have_rcu_nocb_mask = true;
+		}
+		cpumask_or(rcu_nocb_mask, rcu_nocb_mask, tick_nohz_full_mask);
+	}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!have_rcu_nocb_mask)
+		return;
+	cpumask_and(rcu_nocb_mask, rcu_nocb_mask, cpu_possible_mask);
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	pr_info("\tOffload RCU callbacks from CPUs: %s.\n", buf);
+	if (rcu_nocb_poll)
+		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+}
+
+/*
+ * Create the rcuo kthreads of the no-CBs CPUs, bound to the CPUs that
+ * are not offloaded.  If these are not online yet, the kthreads are
+ * left free to run anywhere.
+ */
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct rcu_state *rsp;
+	struct task_struct *t;
+	cpumask_var_t cm;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&cm, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(cm, cpu_possible_mask, rcu_nocb_mask);
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		for_each_rcu_flavor(rsp) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			t = kthread_run(rcu_nocb_kthread, rdp,
+					"rcuo%c/%d", rsp->abbr, cpu);
+			BUG_ON(IS_ERR(t));
+			if (!cpumask_empty(cm))
+				set_cpus_allowed_ptr(t, cm);
+			ACCESS_ONCE(rdp->nocb_kthread) = t;
+		}
+	}
+	free_cpumask_var(cm);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy, unsigned long flags)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_data *rdp)
+{
+}
+
+static bool rcu_nocb_need_deferred_wakeup(struct rcu_data *rdp)
+{
+	return false;
+}
+
+static void do_nocb_deferred_wakeup(struct rcu_data *rdp)
+{
+}
+
+static void rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+static void __init rcu_init_nocb(void)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -42,7 +42,14 @@ SCHED_FEAT(CACHE_HOT_BUDDY, true)
 /*
  * Use arch dependent cpu power functions
  */
-SCHED_FEAT(ARCH_POWER, false)
+SCHED_FEAT(ARCH_POWER, true)
+
+/*
+ * On cpus of different power, wake up a task that needs more than
+ * about 80% of its cpu on a more powerful idle cpu, and let such a
+ * cpu going idle pull the task.
+ */
+SCHED_FEAT(CAPACITY_FIT, true)
 
 SCHED_FEAT(HRTICK, false)
 SCHED_FEAT(DOUBLE_TICK, false)
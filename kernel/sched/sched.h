@@ -3,6 +3,7 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "cpupri.h"
 
@@ -43,6 +44,17 @@ extern __read_mostly int scheduler_running;
  */
 #define RUNTIME_INF	((u64)~0ULL)
 
+/*
+ * Resolution of the -deadline parameters: runtimes below 1 << DL_SCALE
+ * nanoseconds are not accepted.
+ */
+#define DL_SCALE	(10)
+
+static inline int fair_policy(int policy)
+{
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
+}
+
 static inline int rt_policy(int policy)
 {
 	if (policy == SCHED_FIFO || policy == SCHED_RR)
@@ -50,11 +62,21 @@ static inline int rt_policy(int policy)
 	return 0;
 }
 
+static inline int dl_policy(int policy)
+{
+	return unlikely(policy == SCHED_DEADLINE);
+}
+
 static inline int task_has_rt_policy(struct task_struct *p)
 {
 	return rt_policy(p->policy);
 }
 
+static inline int task_has_dl_policy(struct task_struct *p)
+{
+	return dl_policy(p->policy);
+}
+
 /*
  * This is the priority-queue data structure of the RT scheduling class:
  */
@@ -73,6 +95,25 @@ struct rt_bandwidth {
 
 extern struct mutex sched_domains_mutex;
 
+#ifdef CONFIG_SCHEDSTATS
+/*
+ * Histograms of the wakeup latency, from the enqueue of a woken task to
+ * the moment it runs, and of the number of tasks already on the runqueue
+ * at each wakeup.  Latency bucket i > 0 counts the latencies of 2^(i+9)
+ * to 2^(i+10) - 1 ns, bucket 0 the shorter ones and the last one all the
+ * longer ones; depth bucket i > 0 counts 2^(i-1) to 2^i - 1 tasks.
+ * Updated under the rq lock of the cpu.
+ */
+#define SCHED_LAT_BUCKETS	24
+#define SCHED_LAT_SHIFT		10
+#define SCHED_DEPTH_BUCKETS	8
+
+struct sched_lat_hist {
+	unsigned long wakeup_lat[SCHED_LAT_BUCKETS];
+	unsigned long rq_depth[SCHED_DEPTH_BUCKETS];
+};
+#endif
+
 #ifdef CONFIG_CGROUP_SCHED
 
 #include <linux/cgroup.h>
@@ -111,7 +152,10 @@ struct task_group {
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
 
-	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	atomic64_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -133,6 +177,10 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_SCHEDSTATS
+	struct sched_lat_hist __percpu *lat_hist;
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -222,6 +270,22 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	/*
+	 * CFS load tracking: load is tracked per entity and aggregated up.
+	 * runnable_load_avg is the sum of the load contributions of the
+	 * entities queued here, blocked_load_avg that of the entities that
+	 * went to sleep from here, decayed as if they were still tracked.
+	 * decay_counter counts the periods blocked_load_avg was decayed by
+	 * so that a waking entity can catch up with them; removed_load
+	 * collects the contributions of blocked entities that migrated
+	 * away, to be subtracted under rq->lock.
+	 */
+	u64 runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter, removed_load;
+	u64 last_decay;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -247,17 +311,11 @@ struct cfs_rq {
 	unsigned long h_load;
 
 	/*
-	 * Maintaining per-cpu shares distribution for group scheduling
-	 *
-	 * load_stamp is the last time we updated the load average
-	 * load_last is the last time we updated the load average and saw load
-	 * load_unacc_exec_time is currently unaccounted execution time
+	 * This cfs_rq's share of tg->load_avg and tg->runnable_avg, as last
+	 * folded into the task group.
 	 */
-	u64 load_avg;
-	u64 load_period;
-	u64 load_stamp, load_last, load_unacc_exec_time;
-
-	unsigned long load_contribution;
+	u32 tg_runnable_contrib;
+	u64 tg_load_contrib;
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_CFS_BANDWIDTH
 	int runtime_enabled;
@@ -265,6 +323,7 @@ struct cfs_rq {
 	s64 runtime_remaining;
 
 	u64 throttled_timestamp;
+	u64 throttled_clock_task, throttled_clock_task_time;
 	int throttled, throttle_count;
 	struct list_head throttled_list;
 #endif /* CONFIG_CFS_BANDWIDTH */
@@ -309,6 +368,28 @@ struct rt_rq {
 #endif
 };
 
+/*
+ * Bandwidth of the -deadline tasks of a cpu, used for admission
+ * control: total_bw is the sum of the dl_bw of the tasks, bw the
+ * limit (-1 if unlimited).  Both use the fixed point of to_ratio().
+ */
+struct dl_bw {
+	/* nests inside the rq lock: */
+	raw_spinlock_t lock;
+	u64 bw, total_bw;
+};
+
+/* Deadline class' related fields in a runqueue */
+struct dl_rq {
+	/* runqueue is an rbtree, ordered by deadline */
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+
+	unsigned long dl_nr_running;
+
+	struct dl_bw dl_bw;
+};
+
 #ifdef CONFIG_SMP
 
 /*
@@ -332,6 +413,12 @@ struct root_domain {
 	 */
 	cpumask_var_t rto_mask;
 	struct cpupri cpupri;
+
+	/*
+	 * The largest cpu_power_orig of the cpus in the domain, to tell
+	 * when a task could run faster elsewhere.
+	 */
+	unsigned long max_cpu_power_orig;
 };
 
 extern struct root_domain def_root_domain;
@@ -370,6 +457,7 @@ struct rq {
 
 	struct cfs_rq cfs;
 	struct rt_rq rt;
+	struct dl_rq dl;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
@@ -405,6 +493,10 @@ struct rq {
 	struct sched_domain *sd;
 
 	unsigned long cpu_power;
+	/* cpu_power before rt and irq time are taken out of it */
+	unsigned long cpu_power_orig;
+	/* the current task needs a more capable cpu */
+	int misfit_task;
 
 	unsigned char idle_balance;
 	/* For active balancing */
@@ -462,6 +554,8 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	struct sched_lat_hist lat_hist;
 #endif
 
 #ifdef CONFIG_SMP
@@ -847,6 +941,7 @@ enum cpuacct_stat_index {
    for (class = sched_class_highest; class; class = class->next)
 
 extern const struct sched_class stop_sched_class;
+extern const struct sched_class dl_sched_class;
 extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
 extern const struct sched_class idle_sched_class;
@@ -879,6 +974,14 @@ extern void resched_cpu(int cpu);
 extern struct rt_bandwidth def_rt_bandwidth;
 extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime);
 
+extern void init_dl_bw(struct dl_bw *dl_b);
+#ifdef CONFIG_SMP
+extern int dl_bw_move(struct task_struct *p, int cpu, bool force);
+#endif
+extern void init_dl_task_timer(struct sched_dl_entity *dl_se);
+
+unsigned long to_ratio(u64 period, u64 runtime);
+
 extern void update_idle_cpu_load(struct rq *this_rq);
 
 #ifdef CONFIG_CGROUP_CPUACCT
@@ -920,6 +1023,14 @@ static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 static inline void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+
+#ifdef CONFIG_NO_HZ_FULL
+	if (rq->nr_running == 2 && tick_nohz_full_cpu(rq->cpu)) {
+		/* Order rq->nr_running write against the kick */
+		smp_wmb();
+		tick_nohz_full_kick_cpu(rq->cpu);
+	}
+#endif
 }
 
 static inline void dec_nr_running(struct rq *rq)
@@ -1141,9 +1252,14 @@ extern struct sched_entity *__pick_first_entity(struct cfs_rq *cfs_rq);
 extern struct sched_entity *__pick_last_entity(struct cfs_rq *cfs_rq);
 extern void print_cfs_stats(struct seq_file *m, int cpu);
 extern void print_rt_stats(struct seq_file *m, int cpu);
+extern void print_dl_stats(struct seq_file *m, int cpu);
 
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
+#ifdef CONFIG_SMP
+extern void init_task_runnable_average(struct task_struct *p);
+#endif
 extern void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq);
+extern void init_dl_rq(struct dl_rq *dl_rq, struct rq *rq);
 
 extern void account_cfs_bandwidth_used(int enabled, int was_enabled);
 
@@ -3,6 +3,8 @@
 #include <linux/fs.h>
 #include <linux/seq_file.h>
 #include <linux/proc_fs.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
 
 #include "sched.h"
 
@@ -109,3 +111,147 @@ static int __init proc_schedstat_init(void)
 	return 0;
 }
 module_init(proc_schedstat_init);
+
+/*
+ * /sys/kernel/debug/sched_latency: the wakeup latency and runqueue depth
+ * histograms of each cpu and of each task group.  Writing to it clears
+ * them.
+ */
+#define SCHED_LATENCY_VERSION 1
+
+static void show_lat_hist(struct seq_file *seq, struct sched_lat_hist *h)
+{
+	int i;
+
+	seq_printf(seq, " lat");
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(seq, " %lu", h->wakeup_lat[i]);
+	seq_printf(seq, " depth");
+	for (i = 0; i < SCHED_DEPTH_BUCKETS; i++)
+		seq_printf(seq, " %lu", h->rq_depth[i]);
+	seq_printf(seq, "\n");
+}
+
+#ifdef CONFIG_CGROUP_SCHED
+static void show_task_group_lat_hist(struct seq_file *seq, char *path)
+{
+	struct sched_lat_hist sum;
+	struct task_group *tg;
+	int cpu, i;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(tg, &task_groups, list) {
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			struct sched_lat_hist *h = per_cpu_ptr(tg->lat_hist, cpu);
+
+			for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+				sum.wakeup_lat[i] += h->wakeup_lat[i];
+			for (i = 0; i < SCHED_DEPTH_BUCKETS; i++)
+				sum.rq_depth[i] += h->rq_depth[i];
+		}
+
+		if (!autogroup_path(tg, path, PATH_MAX)) {
+			/* May be NULL if the cgroup isn't fully-created yet */
+			if (!tg->css.cgroup)
+				continue;
+			cgroup_path(tg->css.cgroup, path, PATH_MAX);
+		}
+		seq_printf(seq, "group %s", path);
+		show_lat_hist(seq, &sum);
+	}
+	rcu_read_unlock();
+}
+
+static void clear_task_group_lat_hist(int cpu)
+{
+	struct task_group *tg;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(tg, &task_groups, list)
+		memset(per_cpu_ptr(tg->lat_hist, cpu), 0,
+		       sizeof(struct sched_lat_hist));
+	rcu_read_unlock();
+}
+#else
+static inline void show_task_group_lat_hist(struct seq_file *seq, char *path)
+{
+}
+
+static inline void clear_task_group_lat_hist(int cpu)
+{
+}
+#endif
+
+static int show_sched_latency(struct seq_file *seq, void *v)
+{
+	char *path = NULL;
+	int cpu, i;
+
+#ifdef CONFIG_CGROUP_SCHED
+	path = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+#endif
+
+	seq_printf(seq, "version %d\n", SCHED_LATENCY_VERSION);
+	seq_printf(seq, "timestamp %lu\n", jiffies);
+
+	/* The upper bound of each bucket but the last */
+	seq_printf(seq, "lat_ns");
+	for (i = 0; i < SCHED_LAT_BUCKETS - 1; i++)
+		seq_printf(seq, " %llu",
+			   (1ULL << (i + SCHED_LAT_SHIFT)) - 1);
+	seq_printf(seq, "\ndepth");
+	for (i = 0; i < SCHED_DEPTH_BUCKETS - 1; i++)
+		seq_printf(seq, " %u", (1U << i) - 1);
+	seq_printf(seq, "\n");
+
+	for_each_online_cpu(cpu) {
+		seq_printf(seq, "cpu%d", cpu);
+		show_lat_hist(seq, &cpu_rq(cpu)->lat_hist);
+	}
+	show_task_group_lat_hist(seq, path);
+
+	kfree(path);
+	return 0;
+}
+
+static int sched_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_sched_latency, NULL);
+}
+
+static ssize_t sched_latency_write(struct file *file, const char __user *ubuf,
+				   size_t cnt, loff_t *ppos)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		raw_spin_lock_irq(&rq->lock);
+		memset(&rq->lat_hist, 0, sizeof(rq->lat_hist));
+		clear_task_group_lat_hist(cpu);
+		raw_spin_unlock_irq(&rq->lock);
+	}
+
+	*ppos += cnt;
+	return cnt;
+}
+
+static const struct file_operations sched_latency_fops = {
+	.open		= sched_latency_open,
+	.read		= seq_read,
+	.write		= sched_latency_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static __init int sched_latency_init(void)
+{
+	debugfs_create_file("sched_latency", 0644, NULL, NULL,
+			    &sched_latency_fops);
+	return 0;
+}
+late_initcall(sched_latency_init);
@@ -29,6 +29,56 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 	if (rq)
 		rq->rq_sched_info.run_delay += delta;
 }
+
+static inline struct sched_lat_hist *
+task_group_lat_hist(struct rq *rq, struct task_struct *t)
+{
+#ifdef CONFIG_CGROUP_SCHED
+	return per_cpu_ptr(t->sched_task_group->lat_hist, cpu_of(rq));
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * @t is being woken up on @rq: note how many tasks it finds there, and
+ * that its wait to run is a wakeup latency.  Expects the runqueue lock
+ * to be held.
+ */
+static inline void sched_lat_wakeup(struct rq *rq, struct task_struct *t)
+{
+	struct sched_lat_hist *tg_hist = task_group_lat_hist(rq, t);
+	int i = min_t(int, fls(rq->nr_running), SCHED_DEPTH_BUCKETS - 1);
+
+	rq->lat_hist.rq_depth[i]++;
+	if (tg_hist)
+		tg_hist->rq_depth[i]++;
+	t->sched_info.woken = 1;
+}
+
+/*
+ * @t runs on @rq after waiting @delta ns.  Expects the runqueue lock to
+ * be held.
+ */
+static inline void
+sched_lat_arrive(struct rq *rq, struct task_struct *t, unsigned long long delta)
+{
+	struct sched_lat_hist *tg_hist;
+	int i;
+
+	if (!t->sched_info.woken)
+		return;
+	t->sched_info.woken = 0;
+
+	i = fls64(delta >> SCHED_LAT_SHIFT);
+	if (i >= SCHED_LAT_BUCKETS)
+		i = SCHED_LAT_BUCKETS - 1;
+
+	rq->lat_hist.wakeup_lat[i]++;
+	tg_hist = task_group_lat_hist(rq, t);
+	if (tg_hist)
+		tg_hist->wakeup_lat[i]++;
+}
 # define schedstat_inc(rq, field)	do { (rq)->field++; } while (0)
 # define schedstat_add(rq, field, amt)	do { (rq)->field += (amt); } while (0)
 # define schedstat_set(var, val)	do { var = (val); } while (0)
@@ -42,6 +92,11 @@ rq_sched_info_dequeued(struct rq *rq, unsigned long long delta)
 static inline void
 rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 {}
+static inline void sched_lat_wakeup(struct rq *rq, struct task_struct *t)
+{}
+static inline void
+sched_lat_arrive(struct rq *rq, struct task_struct *t, unsigned long long delta)
+{}
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
@@ -89,6 +144,7 @@ static void sched_info_arrive(struct task_struct *t)
 	t->sched_info.pcount++;
 
 	rq_sched_info_arrive(task_rq(t), delta);
+	sched_lat_arrive(task_rq(t), t, delta);
 }
 
 /*
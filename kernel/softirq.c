@@ -347,8 +347,13 @@ void irq_exit(void)
 		invoke_softirq();
 
 #ifdef CONFIG_NO_HZ
-	/* Make sure that timer wheel updates are propagated */
-	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
+	/*
+	 * Make sure that timer wheel updates are propagated, and let a
+	 * busy full dynticks cpu stop or restart its tick.
+	 */
+	if (!in_interrupt() &&
+	    ((idle_cpu(smp_processor_id()) && !need_resched()) ||
+	     tick_nohz_full_cpu(smp_processor_id())))
 		tick_nohz_irq_exit();
 #endif
 	rcu_irq_exit();
@@ -206,3 +206,4 @@ cond_syscall(compat_sys_open_by_handle_at);
 
 /* compare kernel pointers */
 cond_syscall(sys_kcmp);
+cond_syscall(sys_userfaultfd);
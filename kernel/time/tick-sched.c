@@ -15,8 +15,11 @@
 #include <linux/err.h>
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
+#include <linux/irq_work.h>
 #include <linux/kernel_stat.h>
 #include <linux/percpu.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
@@ -301,6 +304,15 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 			delta_jiffies = rcu_delta_jiffies;
 		}
 	}
+
+	/*
+	 * A busy full dynticks cpu still gives the scheduler and the
+	 * accounting one tick per second.
+	 */
+	if (!ts->inidle && delta_jiffies > HZ) {
+		next_jiffies = last_jiffies + HZ;
+		delta_jiffies = HZ;
+	}
 	/*
 	 * Do not stop the tick, if we are only one off
 	 * or if the cpu is required for rcu
@@ -372,8 +384,10 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-			calc_load_enter_idle();
+			if (ts->inidle) {
+				select_nohz_load_balancer(1);
+				calc_load_enter_idle();
+			}
 
 			ts->last_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
@@ -430,6 +444,16 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
 		return false;
 
+	/*
+	 * The full dynticks cpus never take the do_timer() duty over, so
+	 * the cpu holding it keeps its tick even when idle.
+	 */
+	if (tick_nohz_full_enabled()) {
+		if (tick_do_timer_cpu == cpu ||
+		    tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+			return false;
+	}
+
 	if (need_resched())
 		return false;
 
@@ -447,6 +471,250 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	return true;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+
+static void tick_nohz_restart(struct tick_sched *ts, ktime_t now);
+
+/*
+ * Parse the nohz_full= boot parameter. The boot cpu does the
+ * timekeeping for the others and can not be a full dynticks cpu.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		printk(KERN_WARNING "NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		printk(KERN_WARNING "NOHZ: Clearing %d from nohz_full range "
+		       "for timekeeping\n", cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static int __cpuinit tick_nohz_full_cpu_callback(struct notifier_block *nfb,
+						 unsigned long action,
+						 void *hcpu)
+{
+	unsigned int cpu = (unsigned long)hcpu;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_DOWN_PREPARE:
+		/* The full dynticks cpus rely on the timekeeper's tick */
+		if (tick_do_timer_cpu == cpu)
+			return NOTIFY_BAD;
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init tick_nohz_full_init(void)
+{
+	char buf[64];
+
+	if (!tick_nohz_full_running)
+		return 0;
+
+	hotcpu_notifier(tick_nohz_full_cpu_callback, 0);
+
+	cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+	printk(KERN_INFO "NOHZ: Full dynticks CPUs: %s.\n", buf);
+
+	return 0;
+}
+early_initcall(tick_nohz_full_init);
+
+/*
+ * Nothing to do here: going through irq_exit() is all it takes for
+ * the cpu to reevaluate its tick.
+ */
+static void nohz_full_kick_func(struct irq_work *work)
+{
+}
+
+static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) = {
+	.func = nohz_full_kick_func,
+};
+
+/**
+ * tick_nohz_full_kick_cpu - make a full dynticks cpu reevaluate its tick
+ * @cpu: the cpu to kick
+ *
+ * Called with preemption disabled after a change which may need the
+ * tick back on @cpu: a second runnable task, a new timer, an armed
+ * POSIX CPU timer, or RCU waiting for a quiescent state.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	if (cpu != smp_processor_id()) {
+		smp_send_reschedule(cpu);
+		return;
+	}
+
+	/* Only a stopped tick can miss a change made on this cpu */
+	if (__get_cpu_var(tick_cpu_sched).tick_stopped)
+		irq_work_queue(&__get_cpu_var(nohz_full_kick_work));
+}
+
+/**
+ * tick_nohz_full_kick_all - kick all the online full dynticks cpus
+ */
+void tick_nohz_full_kick_all(void)
+{
+	int cpu;
+
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	for_each_cpu_and(cpu, tick_nohz_full_mask, cpu_online_mask)
+		tick_nohz_full_kick_cpu(cpu);
+	preempt_enable();
+}
+
+/*
+ * The tick does not account the time of a busy full dynticks cpu while
+ * it is stopped, so the missed ticks are charged to the task in bulk:
+ * by the tick when it fires, on context switch, and when the tick is
+ * restarted. @accounted is the number of ticks the caller charges
+ * itself.
+ */
+static void tick_nohz_full_account_ticks(struct tick_sched *ts,
+					 struct task_struct *p, int user,
+					 unsigned long accounted)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks;
+
+	ticks = jiffies - ts->full_jiffies;
+	ts->full_jiffies = jiffies;
+	/*
+	 * We might be one off. Do not randomly account a huge number of ticks!
+	 */
+	if (ticks <= accounted || ticks >= LONG_MAX)
+		return;
+
+	ticks -= accounted;
+	if (is_idle_task(p))
+		account_idle_ticks(ticks);
+	else
+		account_busy_ticks(p, user, ticks);
+#endif
+}
+
+/*
+ * Interrupts which do not record their register frame leave us to
+ * guess the mode from the task: user tasks are assumed to have spent
+ * the time in user space.
+ */
+static int tick_nohz_full_user_tick(void)
+{
+	struct pt_regs *regs = get_irq_regs();
+
+	if (regs)
+		return user_mode(regs);
+
+	return current->mm != NULL;
+}
+
+/**
+ * __tick_nohz_full_task_switch - account busy ticks on context switch
+ * @prev: the task which ran with the tick stopped
+ *
+ * Called with the runqueue lock held.
+ */
+void __tick_nohz_full_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->tick_stopped && !ts->inidle)
+		tick_nohz_full_account_ticks(ts, prev, prev->mm != NULL, 0);
+	local_irq_restore(flags);
+}
+
+static bool can_stop_full_tick(int cpu)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (!posix_cpu_timers_can_stop_tick(current))
+		return false;
+
+	if (!perf_event_can_stop_tick())
+		return false;
+
+	if (rcu_nohz_full_needs_cpu(cpu))
+		return false;
+
+	if (local_softirq_pending())
+		return false;
+
+	return true;
+}
+
+static void tick_nohz_full_restart_tick(struct tick_sched *ts, ktime_t now)
+{
+	tick_nohz_full_account_ticks(ts, current, tick_nohz_full_user_tick(),
+				     0);
+	touch_softlockup_watchdog();
+
+	ts->tick_stopped = 0;
+	tick_nohz_restart(ts, now);
+}
+
+/*
+ * Stop the tick of a full dynticks cpu running a single task, or bring
+ * it back when something needs it. Called on interrupt exit.
+ */
+static void tick_nohz_full_update_tick(struct tick_sched *ts)
+{
+	int cpu = smp_processor_id();
+
+	if (!tick_nohz_full_cpu(cpu) || is_idle_task(current))
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (can_stop_full_tick(cpu)) {
+		int was_stopped = ts->tick_stopped;
+
+		tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+		if (!was_stopped && ts->tick_stopped)
+			ts->full_jiffies = ts->last_jiffies;
+	} else if (ts->tick_stopped) {
+		tick_nohz_full_restart_tick(ts, ktime_get());
+	}
+}
+#else
+static inline void tick_nohz_full_account_ticks(struct tick_sched *ts,
+						struct task_struct *p,
+						int user,
+						unsigned long accounted) { }
+static inline void tick_nohz_full_restart_tick(struct tick_sched *ts,
+					       ktime_t now) { }
+static inline void tick_nohz_full_update_tick(struct tick_sched *ts) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
 static void __tick_nohz_idle_enter(struct tick_sched *ts)
 {
 	ktime_t now, expires;
@@ -499,6 +767,12 @@ void tick_nohz_idle_enter(void)
 	local_irq_disable();
 
 	ts = &__get_cpu_var(tick_cpu_sched);
+	/*
+	 * Leave the busy dynticks mode first, so that the idle time and
+	 * the idle tick stop are accounted as usual.
+	 */
+	if (ts->tick_stopped)
+		tick_nohz_full_restart_tick(ts, ktime_get());
 	/*
 	 * set ts->inidle unconditionally. even if the system did not
 	 * switch to nohz mode the cpu frequency governers rely on the
@@ -517,15 +791,18 @@ void tick_nohz_idle_enter(void)
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
  * So we need to re-calculate and reprogram the next tick event.
+ *
+ * On a busy full dynticks cpu, this is where the tick is stopped
+ * or restarted.
  */
 void tick_nohz_irq_exit(void)
 {
 	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
 
-	if (!ts->inidle)
-		return;
-
-	__tick_nohz_idle_enter(ts);
+	if (ts->inidle)
+		__tick_nohz_idle_enter(ts);
+	else
+		tick_nohz_full_update_tick(ts);
 }
 
 /**
@@ -660,7 +937,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -674,10 +952,15 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * waiting on the login prompt. We also increment the "start
 	 * of idle" jiffy stamp so the idle accounting adjustment we
 	 * do when we go busy again does not account too much ticks.
+	 * A busy full dynticks cpu gets the ticks it missed accounted.
 	 */
 	if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
-		ts->idle_jiffies++;
+		if (is_idle_task(current))
+			ts->idle_jiffies++;
+		else
+			tick_nohz_full_account_ticks(ts, current,
+						     user_mode(regs), 1);
 	}
 
 	update_process_times(user_mode(regs));
@@ -776,6 +1059,10 @@ static inline void tick_check_nohz(int cpu)
 
 static inline void tick_nohz_switch_to_nohz(void) { }
 static inline void tick_check_nohz(int cpu) { }
+static inline void tick_nohz_full_account_ticks(struct tick_sched *ts,
+						struct task_struct *p,
+						int user,
+						unsigned long accounted) { }
 
 #endif /* NO_HZ */
 
@@ -812,7 +1099,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -832,11 +1120,15 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		 * waiting on the login prompt. We also increment the "start of
 		 * idle" jiffy stamp so the idle accounting adjustment we do
 		 * when we go busy again does not account too much ticks.
+		 * A busy full dynticks cpu gets the ticks it missed accounted.
 		 */
 		if (ts->tick_stopped) {
 			touch_softlockup_watchdog();
 			if (is_idle_task(current))
 				ts->idle_jiffies++;
+			else
+				tick_nohz_full_account_ticks(ts, current,
+							     user_mode(regs), 1);
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
@@ -0,0 +1,243 @@
+/*
+ * kernel/timer-bench.c
+ *
+ * Measure the timer wheel: the cost of add_timer/mod_timer/del_timer with
+ * a large population of pending timers, the cost per timer of expiring a
+ * batch of timers, and the jitter of a timer rearmed every jiffy while
+ * that population is pending, which shows the time the timer softirq
+ * spends in bookkeeping at each tick.
+ *
+ * The timeouts of the population mimic TCP: retransmit timers of a few
+ * hundred milliseconds, delayed ack and probe timers of up to ten minutes
+ * and two hour keepalive timers.  Everything runs on one cpu.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "timer-bench: " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/timer.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+
+static unsigned int nr_timers = 100000;
+module_param(nr_timers, uint, 0444);
+MODULE_PARM_DESC(nr_timers, "Number of pending timers");
+
+static unsigned int seconds = 5;
+module_param(seconds, uint, 0444);
+MODULE_PARM_DESC(seconds, "Duration of the tick jitter measurement");
+
+static int cpu;
+module_param(cpu, int, 0444);
+MODULE_PARM_DESC(cpu, "CPU to run on");
+
+static struct timer_list *timers;
+static unsigned long *timeouts;
+
+static atomic_t nr_expired;
+static ktime_t first_expiry, last_expiry;
+static DECLARE_COMPLETION(expired);
+
+static struct timer_list probe;
+static unsigned long probe_end;
+static ktime_t probe_last;
+static u64 probe_max, probe_sum;
+static unsigned long probe_count, probe_late;
+static DECLARE_COMPLETION(probe_done);
+
+static unsigned long pick_timeout(void)
+{
+	u32 r = random32();
+
+	switch (r % 4) {
+	case 0:
+		return msecs_to_jiffies(200 + r % 1000);	/* retransmit */
+	case 1:
+	case 2:
+		return msecs_to_jiffies(10000 + r % 600000);	/* probes */
+	default:
+		return 7200 * HZ + r % HZ;			/* keepalive */
+	}
+}
+
+static void dummy_fn(unsigned long data)
+{
+}
+
+static void expire_fn(unsigned long data)
+{
+	ktime_t now = ktime_get();
+
+	if (atomic_inc_return(&nr_expired) == 1)
+		first_expiry = now;
+	last_expiry = now;
+	if (atomic_read(&nr_expired) == nr_timers)
+		complete(&expired);
+}
+
+static void probe_fn(unsigned long data)
+{
+	ktime_t now = ktime_get();
+	u64 delta = ktime_to_ns(ktime_sub(now, probe_last));
+
+	probe_last = now;
+	if (probe_count++) {
+		delta = delta > TICK_NSEC ? delta - TICK_NSEC : 0;
+		if (delta > probe_max)
+			probe_max = delta;
+		if (delta > TICK_NSEC / 10)
+			probe_late++;
+		probe_sum += delta;
+	}
+	if (time_before(jiffies, probe_end))
+		mod_timer_pinned(&probe, jiffies + 1);
+	else
+		complete(&probe_done);
+}
+
+static u64 ns_per_timer(ktime_t start)
+{
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), nr_timers);
+}
+
+static void bench_add_mod_del(void)
+{
+	u64 add, mod, del;
+	ktime_t start;
+	unsigned int i;
+
+	for (i = 0; i < nr_timers; i++)
+		setup_timer(&timers[i], dummy_fn, 0);
+
+	start = ktime_get();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer_pinned(&timers[i], jiffies + timeouts[i]);
+	add = ns_per_timer(start);
+
+	/* Rearm a bit later, as networking does on each packet */
+	start = ktime_get();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer_pinned(&timers[i], jiffies + timeouts[i] + 1);
+	mod = ns_per_timer(start);
+
+	start = ktime_get();
+	for (i = 0; i < nr_timers; i++)
+		del_timer(&timers[i]);
+	del = ns_per_timer(start);
+
+	pr_info("%u timers: add %llu ns, mod %llu ns, del %llu ns per timer\n",
+		nr_timers, add, mod, del);
+}
+
+static void bench_expire(void)
+{
+	unsigned long expires = jiffies + 2;
+	unsigned int i;
+
+	atomic_set(&nr_expired, 0);
+	for (i = 0; i < nr_timers; i++) {
+		setup_timer(&timers[i], expire_fn, 0);
+		timers[i].expires = expires;
+		add_timer_on(&timers[i], cpu);
+	}
+	if (!wait_for_completion_timeout(&expired, 10 * HZ)) {
+		pr_info("expire: only %d of %u timers expired\n",
+			atomic_read(&nr_expired), nr_timers);
+		return;
+	}
+	pr_info("expire: %llu ns per timer\n",
+		div_u64(ktime_to_ns(ktime_sub(last_expiry, first_expiry)),
+			nr_timers));
+}
+
+static void bench_tick_jitter(void)
+{
+	unsigned int i;
+
+	/* Long timers that stay pending over the whole measurement */
+	for (i = 0; i < nr_timers; i++) {
+		setup_timer(&timers[i], dummy_fn, 0);
+		mod_timer_pinned(&timers[i],
+				 jiffies + (seconds + 10) * HZ + timeouts[i]);
+	}
+
+	probe_end = jiffies + seconds * HZ;
+	probe_last = ktime_get();
+	setup_timer(&probe, probe_fn, 0);
+	mod_timer_pinned(&probe, jiffies + 1);
+	wait_for_completion(&probe_done);
+	del_timer_sync(&probe);
+
+	for (i = 0; i < nr_timers; i++)
+		del_timer(&timers[i]);
+
+	if (probe_count < 2)
+		return;
+	pr_info("tick jitter with %u pending timers: max %llu ns, avg %llu ns, "
+		"%lu of %lu ticks late by more than %lu ns\n", nr_timers,
+		probe_max, div_u64(probe_sum, probe_count - 1), probe_late,
+		probe_count - 1, TICK_NSEC / 10);
+}
+
+static int timer_bench_thread(void *unused)
+{
+	struct completion *done = unused;
+	unsigned int i;
+
+	for (i = 0; i < nr_timers; i++)
+		timeouts[i] = pick_timeout();
+
+	bench_add_mod_del();
+	bench_expire();
+	bench_tick_jitter();
+
+	complete(done);
+	return 0;
+}
+
+static int __init timer_bench_init(void)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct task_struct *t;
+	int ret = -ENOMEM;
+
+	if (!nr_timers || !seconds || cpu < 0 || cpu >= nr_cpu_ids ||
+	    !cpu_online(cpu))
+		return -EINVAL;
+
+	timers = vzalloc(nr_timers * sizeof(*timers));
+	timeouts = vmalloc(nr_timers * sizeof(*timeouts));
+	if (!timers || !timeouts)
+		goto out;
+
+	t = kthread_create(timer_bench_thread, &done, "timer_bench");
+	if (IS_ERR(t)) {
+		ret = PTR_ERR(t);
+		goto out;
+	}
+	kthread_bind(t, cpu);
+	wake_up_process(t);
+	wait_for_completion(&done);
+
+	/* nothing to keep loaded */
+	ret = -EAGAIN;
+out:
+	vfree(timeouts);
+	vfree(timers);
+	return ret;
+}
+module_init(timer_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Benchmark for the timer wheel");
@@ -55,23 +55,63 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The per-CPU timer wheel.
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets each.  Level n has
+ * a granularity of LVL_GRAN(n) = 8^n jiffies and takes the timeouts from
+ * LVL_START(n) to LVL_START(n + 1) jiffies, where LVL_START(n) is
+ * 63 * 8^(n - 1).  A timer is queued once, in the bucket its expiry time
+ * rounds up to at the granularity of its level, and stays there until
+ * that bucket expires: timers are never cascaded from one level to the
+ * next.  The price is that a timer whose timeout does not fit in level 0
+ * expires up to one granularity late, which is at most about 1/8 of
+ * its timeout.  The timeouts that matter to the jiffy, like most networking
+ * timeouts which are usually deleted or rearmed long before they expire,
+ * are not hurt by that.
+ *
+ *	HZ 1000				HZ 100
+ *	lvl gran	range		lvl gran	range
+ *	0   1 ms	0 - 62 ms	0   10 ms	0 - 620 ms
+ *	1   8 ms	63 ms - 503 ms	1   80 ms	630 ms - 5 s
+ *	2   64 ms	504 ms - 4 s	2   640 ms	5 s - 40 s
+ *	3   512 ms	4 s - 32 s	3   5 s		40 s - 5 m
+ *	4   4 s		32 s - 4 m	4   40 s	5 m - 43 m
+ *	5   32 s	4 m - 34 m	5   5 m		43 m - 5 h
+ *	6   4 m		34 m - 4 h	6   43 m	5 h - 45 h
+ *	7   35 m	4 h - 36 h	7   6 h		45 h - 15 d
+ *	8   5 h		36 h - 12 d
+ *
+ * Timeouts beyond the last level are clamped to WHEEL_TIMEOUT_MAX.
+ *
+ * base->timer_jiffies is the next jiffy to be processed.  At each jiffy,
+ * __run_timers() expires the level 0 bucket of that jiffy and, when the
+ * jiffy is a multiple of the granularity of a level, the bucket of that
+ * level too.  The buckets holding timers are tracked in ->pending_map so
+ * that the next expiring one can be found without walking the lists.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* First timeout, in jiffies, that goes to level n > 0 */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE		(LVL_SIZE * LVL_DEPTH)
 
 struct tvec_base {
 	spinlock_t lock;
@@ -79,11 +119,8 @@ struct tvec_base {
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
 	unsigned long active_timers;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -332,59 +369,67 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
-{
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+/*
+ * Return the bucket index of level @lvl for a timer expiring at @expires,
+ * and in @bucket_expiry the jiffy at which that bucket is expired.  The
+ * expiry time is rounded up so that the timer never fires early.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long)delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
-		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
 	}
+
 	/*
-	 * Timers are FIFO:
+	 * If the timeout is larger than what the wheel covers, we use
+	 * the maximum timeout.
 	 */
-	list_add_tail(&timer->entry, vec);
+	if (delta >= WHEEL_TIMEOUT_CUTOFF)
+		expires = clk + WHEEL_TIMEOUT_MAX;
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+		if (delta < LVL_START(lvl + 1))
+			break;
+	return calc_index(expires, lvl, bucket_expiry);
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
-	__internal_add_timer(base, timer);
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
+	/*
+	 * Timers are FIFO:
+	 */
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+	timer->idx = idx;
+
 	/*
 	 * Update base->active_timers and base->next_timer
 	 */
 	if (!tbase_get_deferrable(timer->base)) {
-		if (time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
+		if (time_before(bucket_expiry, base->next_timer))
+			base->next_timer = bucket_expiry;
 		base->active_timers++;
 	}
 }
@@ -694,13 +739,22 @@ detach_expired_timer(struct timer_list *timer, struct tvec_base *base)
 static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 			     bool clear_pending)
 {
+	unsigned int idx = timer->idx;
+
 	if (!timer_pending(timer))
 		return 0;
 
 	detach_timer(timer, clear_pending);
+	/*
+	 * The timer may also sit on the list of an expiring bucket in
+	 * __run_timers(), whose pending bit is clear already.
+	 */
+	if (list_empty(base->vectors + idx))
+		__clear_bit(idx, base->pending_map);
 	if (!tbase_get_deferrable(timer->base)) {
 		timer->base->active_timers--;
-		if (timer->expires == base->next_timer)
+		/* It may have been the next one: recompute ->next_timer */
+		if (time_before_eq(timer->expires, base->next_timer))
 			base->next_timer = base->timer_jiffies;
 	}
 	return 1;
@@ -743,7 +797,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 						bool pending_only, int pinned)
 {
 	struct tvec_base *base, *new_base;
-	unsigned long flags;
+	unsigned long flags, bucket_expiry;
 	int ret = 0 , cpu;
 
 	timer_stats_timer_set_start_info(timer);
@@ -751,6 +805,21 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	base = lock_timer_base(timer, &flags);
 
+	/*
+	 * If a pending timer is moved within the bucket it sits in, as
+	 * rearmed networking timers mostly are, only ->expires changes.
+	 * While __run_timers() has dropped the lock to run a timer, the
+	 * timers it collected sit on its own lists with stale indexes.
+	 */
+	if (timer_pending(timer) && !base->running_timer &&
+	    calc_wheel_index(expires, base->timer_jiffies,
+			     &bucket_expiry) == timer->idx) {
+		trace_timer_start(timer, expires);
+		timer->expires = expires;
+		ret = 1;
+		goto out_unlock;
+	}
+
 	ret = detach_if_pending(timer, base, false);
 	if (!ret && pending_only)
 		goto out_unlock;
@@ -786,6 +855,10 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	timer->expires = expires;
 	internal_add_timer(base, timer);
 
+	/* A full dynticks cpu may have its tick stopped past the expiry */
+	if (!tbase_get_deferrable(timer->base) && tick_nohz_full_cpu(cpu))
+		tick_nohz_full_kick_cpu(cpu);
+
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
 
@@ -956,9 +1029,11 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * active. We are protected against the other CPU fiddling
 	 * with the timer by holding the timer base lock. This also
 	 * makes sure that a CPU on the way to idle can not evaluate
-	 * the timer wheel.
+	 * the timer wheel. A busy full dynticks cpu is kicked for the
+	 * same reason.
 	 */
 	wake_up_idle_cpu(cpu);
+	tick_nohz_full_kick_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -1086,27 +1161,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1150,52 +1204,152 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+static void expire_timers(struct tvec_base *base, struct list_head *head)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_expired_timer(timer, base);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
+
+/*
+ * Move the buckets that expire at base->timer_jiffies to @heads, one per
+ * level, and return the number of buckets moved.
+ */
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int i, idx;
+	int levels = 0;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_replace_init(base->vectors + idx, heads + levels++);
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
+}
+
+static bool bucket_has_nondeferrable(struct tvec_base *base, unsigned int idx)
+{
+	struct timer_list *nte;
+
+	list_for_each_entry(nte, base->vectors + idx, entry)
+		if (!tbase_get_deferrable(nte->base))
+			return true;
+	return false;
+}
+
+/*
+ * Return how many buckets after the one of level clock @clk the first
+ * bucket of level @lvl holding a timer is, or -1 if there is none.  With
+ * @skip_deferrable, the buckets holding only deferrable timers are not
+ * considered.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int lvl,
+			       unsigned long clk, bool skip_deferrable)
+{
+	unsigned int offset = LVL_OFFS(lvl);
+	unsigned int start = offset + (clk & LVL_MASK);
+	unsigned int end = offset + LVL_SIZE;
+	unsigned int pos;
+
+	for (pos = find_next_bit(base->pending_map, end, start); pos < end;
+	     pos = find_next_bit(base->pending_map, end, pos + 1))
+		if (!skip_deferrable || bucket_has_nondeferrable(base, pos))
+			return pos - start;
+
+	for (pos = find_next_bit(base->pending_map, start, offset); pos < start;
+	     pos = find_next_bit(base->pending_map, start, pos + 1))
+		if (!skip_deferrable || bucket_has_nondeferrable(base, pos))
+			return pos + LVL_SIZE - start;
+
+	return -1;
+}
+
+/*
+ * Return the jiffy at which the first bucket holding a timer expires, or
+ * base->timer_jiffies + NEXT_TIMER_MAX_DELTA if there is none.  With
+ * @skip_deferrable, the buckets holding only deferrable timers are not
+ * considered.  Needs base->lock.
+ */
+static unsigned long __next_bucket_expiry(struct tvec_base *base,
+					  bool skip_deferrable)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned long next = clk + NEXT_TIMER_MAX_DELTA;
+	unsigned long expires;
+	unsigned int lvl;
+	int n;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		n = next_pending_bucket(base, lvl, clk, skip_deferrable);
+		if (n >= 0) {
+			expires = (clk + n) << LVL_SHIFT(lvl);
+			if (time_before(expires, next))
+				next = expires;
+		}
+		/*
+		 * The next bucket to expire in the next level is the one
+		 * the clock of this level rounds up to.
+		 */
+		clk = (clk + LVL_CLK_MASK) >> LVL_CLK_SHIFT;
+	}
+	return next;
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function executes all expired timer vectors.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[LVL_DEPTH];
+	unsigned long next;
+	int levels;
 
 	spin_lock_irq(&base->lock);
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
 		/*
-		 * Cascade timers:
+		 * After a long idle period, skip the jiffies for which
+		 * there is nothing to expire rather than walking them.
 		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
-		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_expired_timer(timer, base);
-
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
+		if ((long)(jiffies - base->timer_jiffies) > 2) {
+			next = __next_bucket_expiry(base, false);
+			if (time_after(next, jiffies)) {
+				base->timer_jiffies = jiffies + 1;
+				break;
+			}
+			base->timer_jiffies = next;
 		}
+		levels = collect_expired_timers(base, heads);
+		++base->timer_jiffies;
+		while (levels--)
+			expire_timers(base, heads + levels);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
@@ -1209,72 +1363,7 @@ static inline void __run_timers(struct tvec_base *base)
  */
 static unsigned long __next_timer_interrupt(struct tvec_base *base)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
-		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
-	}
-	return expires;
+	return __next_bucket_expiry(base, true);
 }
 
 /*
@@ -1699,14 +1788,9 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1746,14 +1830,9 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, WHEEL_SIZE);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -18,7 +18,8 @@
  * executed in process context.  The worker pool is shared and
  * automatically managed.  There is one worker pool for each CPU and
  * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * not bound to any specific CPU.  More unbound ones are created on
+ * demand for unbound workqueues with custom worker attributes.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +42,7 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/device.h>
 
 #include "workqueue_sched.h"
 
@@ -63,6 +65,7 @@ enum {
 	 */
 	GCWQ_DISASSOCIATED	= 1 << 0,	/* cpu can't serve workers */
 	GCWQ_FREEZING		= 1 << 1,	/* freeze in progress */
+	GCWQ_RELEASING		= 1 << 2,	/* workers being destroyed */
 
 	/* pool flags */
 	POOL_MANAGE_WORKERS	= 1 << 0,	/* need to manage workers */
@@ -94,6 +97,7 @@ enum {
 						   (min two ticks) */
 	MAYDAY_INTERVAL		= HZ / 10,	/* and then every 100ms */
 	CREATE_COOLDOWN		= HZ,		/* time to breath after fail */
+	MOVE_TIMEOUT		= 10 * HZ,	/* give up moving a busy cwq */
 
 	/*
 	 * Rescue workers are used only on emergencies and shared by
@@ -122,11 +126,14 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * A: wq_attrs_mutex protected.
  */
 
 struct global_cwq;
 struct worker_pool;
 struct idle_rebind;
+struct wq_device;
 
 /*
  * The poor guys doing the actual heavy lifting.  All on-duty workers
@@ -177,8 +184,16 @@ struct worker_pool {
  */
 struct global_cwq {
 	spinlock_t		lock;		/* the gcwq lock */
-	unsigned int		cpu;		/* I: the associated cpu */
+	unsigned int		cpu;		/* I: the associated cpu or
+						   the id of an unbound gcwq */
 	unsigned int		flags;		/* L: GCWQ_* flags */
+	struct workqueue_attrs	*attrs;		/* A: worker attributes of
+						   an unbound gcwq */
+	int			refcnt;		/* A: cwqs of an unbound gcwq
+						   with attributes, -1 once
+						   its workers are gone */
+	struct work_struct	release_work;	/* destroys the workers */
+	wait_queue_head_t	release_wait;	/* workers going idle */
 
 	/* workers are chained either in busy_hash or pool idle_list */
 	struct hlist_head	busy_hash[BUSY_WORKER_HASH_SIZE];
@@ -193,9 +208,13 @@ struct global_cwq {
  * The per-CPU workqueue.  The lower WORK_STRUCT_FLAG_BITS of
  * work_struct->data are used for flags and thus cwqs need to be
  * aligned at two's power of the number of flag bits.
+ *
+ * The pool of the cwq of an unbound workqueue changes with the
+ * workqueue's attributes, under the old gcwq->lock.  See
+ * move_unbound_cwq().
  */
 struct cpu_workqueue_struct {
-	struct worker_pool	*pool;		/* I: the associated pool */
+	struct worker_pool	*pool;		/* L: the associated pool */
 	struct workqueue_struct *wq;		/* I: the owning workqueue */
 	int			work_color;	/* L: current color */
 	int			flush_color;	/* L: flushing color */
@@ -204,6 +223,7 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+	struct global_cwq	*move_to;	/* L&A: gcwq being moved to */
 };
 
 /*
@@ -262,6 +282,9 @@ struct workqueue_struct {
 
 	int			nr_drainers;	/* W: drain in progress */
 	int			saved_max_active; /* W: saved cwq max_active */
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* I: for sysfs interface */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
@@ -292,6 +315,22 @@ EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
 	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)			\
 		hlist_for_each_entry(worker, pos, &gcwq->busy_hash[i], hentry)
 
+/*
+ * Unbound gcwqs other than the default one are created on demand for the
+ * attributes of unbound workqueues.  Their ids follow WORK_CPU_NONE in
+ * the cpu number space, so that work->data can refer to them.  Work
+ * items may keep referring to them, so they are never freed: once no
+ * workqueue uses one, its workers are destroyed and it is reused for
+ * the next attributes.  See get_unbound_gcwq() and put_unbound_gcwq().
+ */
+enum {
+	WQ_ATTRS_GCWQ_BASE	= WORK_CPU_NONE + 1,
+	WQ_MAX_ATTRS_GCWQS	= 64,
+};
+
+static struct global_cwq *attrs_gcwqs[WQ_MAX_ATTRS_GCWQS]; /* A & W */
+static unsigned int nr_attrs_gcwqs;			   /* A & W */
+
 static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 				  unsigned int sw)
 {
@@ -304,6 +343,14 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 		if (sw & 2)
 			return WORK_CPU_UNBOUND;
 	}
+	if ((sw & 4) && cpu >= WORK_CPU_UNBOUND) {
+		cpu = cpu == WORK_CPU_UNBOUND ? WQ_ATTRS_GCWQ_BASE : cpu + 1;
+		if (cpu - WQ_ATTRS_GCWQ_BASE < ACCESS_ONCE(nr_attrs_gcwqs)) {
+			/* pairs with smp_wmb() in get_unbound_gcwq() */
+			smp_rmb();
+			return cpu;
+		}
+	}
 	return WORK_CPU_NONE;
 }
 
@@ -321,15 +368,16 @@ static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
  * specific CPU.  The following iterators are similar to
  * for_each_*_cpu() iterators but also considers the unbound gcwq.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
+ * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND + ids
+ *				  of the unbound gcwqs with attributes
  * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
  * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
  *				  WORK_CPU_UNBOUND for unbound workqueues
  */
 #define for_each_gcwq_cpu(cpu)						\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 3))
+	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 7);		\
+	     (cpu) != WORK_CPU_NONE;					\
+	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 7))
 
 #define for_each_online_gcwq_cpu(cpu)					\
 	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 3);		\
@@ -473,7 +521,8 @@ static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, pool_nr_running[NR_WORKER_POOLS])
 /*
  * Global cpu workqueue and nr_running counter for unbound gcwq.  The
  * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * workers have WORKER_UNBOUND set.  The same holds for the unbound
+ * gcwqs with attributes, which share the nr_running counter.
  */
 static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_pool_nr_running[NR_WORKER_POOLS] = {
@@ -489,10 +538,12 @@ static int worker_pool_pri(struct worker_pool *pool)
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(global_cwq, cpu);
-	else
+	else if (cpu == WORK_CPU_UNBOUND)
 		return &unbound_global_cwq;
+	else
+		return attrs_gcwqs[cpu - WQ_ATTRS_GCWQ_BASE];
 }
 
 static atomic_t *get_pool_nr_running(struct worker_pool *pool)
@@ -500,7 +551,7 @@ static atomic_t *get_pool_nr_running(struct worker_pool *pool)
 	int cpu = pool->gcwq->cpu;
 	int idx = worker_pool_pri(pool);
 
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(pool_nr_running, cpu)[idx];
 	else
 		return &unbound_pool_nr_running[idx];
@@ -512,11 +563,41 @@ static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
 			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
+	} else if (likely(cpu == WORK_CPU_UNBOUND ||
+			  cpu >= WQ_ATTRS_GCWQ_BASE))
 		return wq->cpu_wq.single;
 	return NULL;
 }
 
+/* return the cwq of @wq served by @gcwq, NULL if @gcwq serves none */
+static struct cpu_workqueue_struct *get_gcwq_cwq(struct global_cwq *gcwq,
+						 struct workqueue_struct *wq)
+{
+	struct cpu_workqueue_struct *cwq = get_cwq(gcwq->cpu, wq);
+
+	if (cwq && cwq->pool->gcwq != gcwq)
+		return NULL;
+	return cwq;
+}
+
+/*
+ * Lock the gcwq serving @cwq.  The pool of an unbound cwq may change
+ * until the lock of its gcwq is held, see move_unbound_cwq().
+ */
+static struct global_cwq *lock_cwq_gcwq(struct cpu_workqueue_struct *cwq,
+					unsigned long *flags)
+{
+	struct global_cwq *gcwq;
+
+	while (true) {
+		gcwq = ACCESS_ONCE(cwq->pool)->gcwq;
+		spin_lock_irqsave(&gcwq->lock, *flags);
+		if (likely(cwq->pool->gcwq == gcwq))
+			return gcwq;
+		spin_unlock_irqrestore(&gcwq->lock, *flags);
+	}
+}
+
 static unsigned int work_color_to_flags(int color)
 {
 	return color << WORK_STRUCT_COLOR_SHIFT;
@@ -595,7 +676,8 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND &&
+	       cpu - WQ_ATTRS_GCWQ_BASE >= nr_attrs_gcwqs);
 	return get_gcwq(cpu);
 }
 
@@ -1023,8 +1105,7 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 		} else
 			spin_lock_irqsave(&gcwq->lock, flags);
 	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
-		spin_lock_irqsave(&gcwq->lock, flags);
+		gcwq = lock_cwq_gcwq(get_cwq(WORK_CPU_UNBOUND, wq), &flags);
 	}
 
 	/* gcwq determined, get cwq and queue */
@@ -1156,7 +1237,7 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		if (!(wq->flags & WQ_UNBOUND)) {
 			struct global_cwq *gcwq = get_work_gcwq(work);
 
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
+			if (gcwq && gcwq->cpu < WORK_CPU_UNBOUND)
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
@@ -1209,6 +1290,10 @@ static void worker_enter_idle(struct worker *worker)
 	if (too_many_workers(pool) && !timer_pending(&pool->idle_timer))
 		mod_timer(&pool->idle_timer, jiffies + IDLE_WORKER_TIMEOUT);
 
+	/* release_unbound_gcwq() destroys the workers as they go idle */
+	if (unlikely(gcwq->flags & GCWQ_RELEASING))
+		wake_up_all(&gcwq->release_wait);
+
 	/*
 	 * Sanity check nr_running.  Because gcwq_unbind_fn() releases
 	 * gcwq->lock between setting %WORKER_UNBOUND and zapping
@@ -1280,10 +1365,13 @@ __acquires(&gcwq->lock)
 		 * The following call may fail, succeed or succeed
 		 * without actually migrating the task to the cpu if
 		 * it races with cpu hotunplug operation.  Verify
-		 * against GCWQ_DISASSOCIATED.
+		 * against GCWQ_DISASSOCIATED.  A rescuer serving an
+		 * unbound gcwq follows its cpumask.
 		 */
 		if (!(gcwq->flags & GCWQ_DISASSOCIATED))
 			set_cpus_allowed_ptr(task, get_cpu_mask(gcwq->cpu));
+		else if (gcwq->attrs)
+			set_cpus_allowed_ptr(task, gcwq->attrs->cpumask);
 
 		spin_lock_irq(&gcwq->lock);
 		if (gcwq->flags & GCWQ_DISASSOCIATED)
@@ -1542,18 +1630,25 @@ static struct worker *create_worker(struct worker_pool *pool)
 	worker->pool = pool;
 	worker->id = id;
 
-	if (gcwq->cpu != WORK_CPU_UNBOUND)
+	if (gcwq->cpu < WORK_CPU_UNBOUND)
 		worker->task = kthread_create_on_node(worker_thread,
 					worker, cpu_to_node(gcwq->cpu),
 					"kworker/%u:%d%s", gcwq->cpu, id, pri);
-	else
+	else if (gcwq->cpu == WORK_CPU_UNBOUND)
 		worker->task = kthread_create(worker_thread, worker,
 					      "kworker/u:%d%s", id, pri);
+	else
+		worker->task = kthread_create_on_node(worker_thread,
+					worker, gcwq->attrs->node,
+					"kworker/u%u:%d%s",
+					gcwq->cpu - WQ_ATTRS_GCWQ_BASE, id, pri);
 	if (IS_ERR(worker->task))
 		goto fail;
 
 	if (worker_pool_pri(pool))
 		set_user_nice(worker->task, HIGHPRI_NICE_LEVEL);
+	else if (gcwq->attrs)
+		set_user_nice(worker->task, gcwq->attrs->nice);
 
 	/*
 	 * Determine CPU binding of the new worker depending on
@@ -1562,11 +1657,15 @@ static struct worker *create_worker(struct worker_pool *pool)
 	 * above the flag definition for details.
 	 *
 	 * As an unbound worker may later become a regular one if CPU comes
-	 * online, make sure every worker has %PF_THREAD_BOUND set.
+	 * online, make sure every worker has %PF_THREAD_BOUND set.  Workers
+	 * of an unbound gcwq are confined to its cpumask before that, as
+	 * %PF_THREAD_BOUND forbids changing it.
 	 */
 	if (!(gcwq->flags & GCWQ_DISASSOCIATED)) {
 		kthread_bind(worker->task, gcwq->cpu);
 	} else {
+		if (gcwq->attrs)
+			set_cpus_allowed_ptr(worker->task, gcwq->attrs->cpumask);
 		worker->task->flags |= PF_THREAD_BOUND;
 		worker->flags |= WORKER_UNBOUND;
 	}
@@ -1673,8 +1772,8 @@ static bool send_mayday(struct work_struct *work)
 
 	/* mayday mayday mayday */
 	cpu = cwq->pool->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
+	/* unbound gcwq ids can't be set in cpumask, use cpu 0 instead */
+	if (cpu >= WORK_CPU_UNBOUND)
 		cpu = 0;
 	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
 		wake_up_process(wq->rescuer->task);
@@ -1945,6 +2044,9 @@ static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
 	cwq_activate_delayed_work(work);
 }
 
+/* woken up when a cwq being moved has no active work items left */
+static DECLARE_WAIT_QUEUE_HEAD(wq_move_wait);
+
 /**
  * cwq_dec_nr_in_flight - decrement cwq's nr_in_flight
  * @cwq: cwq of interest
@@ -1973,6 +2075,9 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 			if (cwq->nr_active < cwq->max_active)
 				cwq_activate_first_delayed(cwq);
 		}
+		/* the last one left, see move_unbound_cwq() */
+		if (unlikely(cwq->move_to) && !cwq->nr_active)
+			wake_up_all(&wq_move_wait);
 	}
 
 	/* is flush in progress and are we at the flushing tip? */
@@ -2429,9 +2534,10 @@ static bool flush_workqueue_prep_cwqs(struct workqueue_struct *wq,
 
 	for_each_cwq_cpu(cpu, wq) {
 		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-		struct global_cwq *gcwq = cwq->pool->gcwq;
+		struct global_cwq *gcwq;
+		unsigned long flags;
 
-		spin_lock_irq(&gcwq->lock);
+		gcwq = lock_cwq_gcwq(cwq, &flags);
 
 		if (flush_color >= 0) {
 			BUG_ON(cwq->flush_color != -1);
@@ -2448,7 +2554,7 @@ static bool flush_workqueue_prep_cwqs(struct workqueue_struct *wq,
 			cwq->work_color = work_color;
 		}
 
-		spin_unlock_irq(&gcwq->lock);
+		spin_unlock_irqrestore(&gcwq->lock, flags);
 	}
 
 	if (flush_color >= 0 && atomic_dec_and_test(&wq->nr_cwqs_to_flush))
@@ -2643,11 +2749,13 @@ reflush:
 
 	for_each_cwq_cpu(cpu, wq) {
 		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		struct global_cwq *gcwq;
+		unsigned long flags;
 		bool drained;
 
-		spin_lock_irq(&cwq->pool->gcwq->lock);
+		gcwq = lock_cwq_gcwq(cwq, &flags);
 		drained = !cwq->nr_active && list_empty(&cwq->delayed_works);
-		spin_unlock_irq(&cwq->pool->gcwq->lock);
+		spin_unlock_irqrestore(&gcwq->lock, flags);
 
 		if (drained)
 			continue;
@@ -2674,6 +2782,7 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	struct cpu_workqueue_struct *cwq;
 
 	might_sleep();
+retry:
 	gcwq = get_work_gcwq(work);
 	if (!gcwq)
 		return false;
@@ -2682,13 +2791,17 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	if (!list_empty(&work->entry)) {
 		/*
 		 * See the comment near try_to_grab_pending()->smp_rmb().
-		 * If it was re-queued to a different gcwq under us, we
-		 * are not going to wait.
+		 * If it was re-queued to a different gcwq or its unbound
+		 * cwq was moved under us, it's pending there now.
 		 */
 		smp_rmb();
 		cwq = get_work_cwq(work);
-		if (unlikely(!cwq || gcwq != cwq->pool->gcwq))
+		if (unlikely(!cwq))
 			goto already_gone;
+		if (unlikely(gcwq != cwq->pool->gcwq)) {
+			spin_unlock_irq(&gcwq->lock);
+			goto retry;
+		}
 	} else if (wait_executing) {
 		worker = find_worker_executing_work(gcwq, work);
 		if (!worker)
@@ -3133,6 +3246,732 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
+/* A: serializes changes of workqueue attributes */
+static DEFINE_MUTEX(wq_attrs_mutex);
+
+static void init_gcwq(struct global_cwq *gcwq, unsigned int cpu)
+{
+	struct worker_pool *pool;
+	int i;
+
+	spin_lock_init(&gcwq->lock);
+	gcwq->cpu = cpu;
+	gcwq->flags |= GCWQ_DISASSOCIATED;
+
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+
+	for_each_worker_pool(pool, gcwq) {
+		pool->gcwq = gcwq;
+		INIT_LIST_HEAD(&pool->worklist);
+		INIT_LIST_HEAD(&pool->idle_list);
+
+		init_timer_deferrable(&pool->idle_timer);
+		pool->idle_timer.function = idle_worker_timeout;
+		pool->idle_timer.data = (unsigned long)pool;
+
+		setup_timer(&pool->mayday_timer, gcwq_mayday_timeout,
+			    (unsigned long)pool);
+
+		mutex_init(&pool->manager_mutex);
+		ida_init(&pool->worker_ida);
+	}
+
+	init_waitqueue_head(&gcwq->rebind_hold);
+	init_waitqueue_head(&gcwq->release_wait);
+}
+
+/**
+ * alloc_workqueue_attrs - allocate a workqueue_attrs
+ * @gfp_mask: allocation mask to use
+ *
+ * Allocate a workqueue_attrs and initialize it with the attributes of
+ * the default unbound workers: nice level 0, all possible CPUs and no
+ * NUMA node.
+ *
+ * RETURNS:
+ * The new workqueue_attrs on success, %NULL on failure.
+ */
+struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask)
+{
+	struct workqueue_attrs *attrs;
+
+	attrs = kzalloc(sizeof(*attrs), gfp_mask);
+	if (!attrs)
+		return NULL;
+	if (!alloc_cpumask_var(&attrs->cpumask, gfp_mask)) {
+		kfree(attrs);
+		return NULL;
+	}
+
+	attrs->node = NUMA_NO_NODE;
+	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	return attrs;
+}
+EXPORT_SYMBOL_GPL(alloc_workqueue_attrs);
+
+/**
+ * free_workqueue_attrs - free a workqueue_attrs
+ * @attrs: workqueue_attrs to free
+ *
+ * Undo alloc_workqueue_attrs().
+ */
+void free_workqueue_attrs(struct workqueue_attrs *attrs)
+{
+	if (attrs) {
+		free_cpumask_var(attrs->cpumask);
+		kfree(attrs);
+	}
+}
+EXPORT_SYMBOL_GPL(free_workqueue_attrs);
+
+static void copy_workqueue_attrs(struct workqueue_attrs *to,
+				 const struct workqueue_attrs *from)
+{
+	to->nice = from->nice;
+	to->node = from->node;
+	cpumask_copy(to->cpumask, from->cpumask);
+}
+
+static bool wq_attrs_equal(const struct workqueue_attrs *a,
+			   const struct workqueue_attrs *b)
+{
+	return a->nice == b->nice && a->node == b->node &&
+		cpumask_equal(a->cpumask, b->cpumask);
+}
+
+/*
+ * The max_active @cwq should have: zero while it's frozen or being moved
+ * to another gcwq.  Called with the lock of the gcwq of @cwq held.
+ */
+static int cwq_max_active(struct cpu_workqueue_struct *cwq)
+{
+	struct workqueue_struct *wq = cwq->wq;
+
+	if (cwq->move_to ||
+	    (wq->flags & WQ_FREEZABLE && cwq->pool->gcwq->flags & GCWQ_FREEZING))
+		return 0;
+	return wq->saved_max_active;
+}
+
+/* sleep until woken up by worker_enter_idle() */
+static void gcwq_release_wait(struct global_cwq *gcwq)
+__releases(&gcwq->lock)
+__acquires(&gcwq->lock)
+{
+	DEFINE_WAIT(wait);
+
+	prepare_to_wait(&gcwq->release_wait, &wait, TASK_UNINTERRUPTIBLE);
+	spin_unlock_irq(&gcwq->lock);
+	schedule();
+	finish_wait(&gcwq->release_wait, &wait);
+	spin_lock_irq(&gcwq->lock);
+}
+
+/*
+ * Destroy the workers of an unbound gcwq which no workqueue uses any
+ * more.  No work item can be queued on it, so they all go idle once
+ * they're done with the work items still executing.  The gcwq is then
+ * free to be set up for other attributes by get_unbound_gcwq().
+ */
+static void release_unbound_gcwq(struct work_struct *work)
+{
+	struct global_cwq *gcwq = container_of(work, struct global_cwq,
+					       release_work);
+	struct worker_pool *pool;
+	struct worker *worker;
+
+	spin_lock_irq(&gcwq->lock);
+	gcwq->flags |= GCWQ_RELEASING;
+
+	for_each_worker_pool(pool, gcwq) {
+		/* let a manager finish, then keep the workers from managing */
+		while (pool->flags & POOL_MANAGING_WORKERS)
+			gcwq_release_wait(gcwq);
+		pool->flags |= POOL_MANAGING_WORKERS;
+
+		while (pool->nr_workers) {
+			worker = first_worker(pool);
+			if (worker)
+				destroy_worker(worker);
+			else
+				gcwq_release_wait(gcwq);
+		}
+	}
+
+	gcwq->flags &= ~GCWQ_RELEASING;
+	spin_unlock_irq(&gcwq->lock);
+
+	for_each_worker_pool(pool, gcwq) {
+		del_timer_sync(&pool->idle_timer);
+		del_timer_sync(&pool->mayday_timer);
+	}
+
+	spin_lock_irq(&gcwq->lock);
+	for_each_worker_pool(pool, gcwq)
+		pool->flags &= ~(POOL_MANAGE_WORKERS | POOL_MANAGING_WORKERS);
+	spin_unlock_irq(&gcwq->lock);
+
+	mutex_lock(&wq_attrs_mutex);
+	gcwq->refcnt = -1;
+	mutex_unlock(&wq_attrs_mutex);
+}
+
+/*
+ * Allocate a new unbound gcwq for attributes and publish it, without
+ * workers yet.  Returns the gcwq or an ERR_PTR() value.
+ */
+static struct global_cwq *alloc_unbound_gcwq(int node)
+{
+	struct global_cwq *gcwq;
+
+	if (nr_attrs_gcwqs == WQ_MAX_ATTRS_GCWQS)
+		return ERR_PTR(-ENOSPC);
+
+	gcwq = kzalloc_node(sizeof(*gcwq), GFP_KERNEL, node);
+	if (!gcwq)
+		return ERR_PTR(-ENOMEM);
+
+	gcwq->attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!gcwq->attrs) {
+		kfree(gcwq);
+		return ERR_PTR(-ENOMEM);
+	}
+	init_gcwq(gcwq, WQ_ATTRS_GCWQ_BASE + nr_attrs_gcwqs);
+	INIT_WORK(&gcwq->release_work, release_unbound_gcwq);
+	gcwq->refcnt = -1;
+
+	/* publish it, it may have to start frozen */
+	spin_lock(&workqueue_lock);
+	spin_lock_irq(&gcwq->lock);
+	if (workqueue_freezing)
+		gcwq->flags |= GCWQ_FREEZING;
+	spin_unlock_irq(&gcwq->lock);
+
+	attrs_gcwqs[nr_attrs_gcwqs] = gcwq;
+	/* pairs with smp_rmb() in __next_gcwq_cpu() */
+	smp_wmb();
+	nr_attrs_gcwqs++;
+	spin_unlock(&workqueue_lock);
+
+	return gcwq;
+}
+
+/**
+ * get_unbound_gcwq - find or create the unbound gcwq for attributes
+ * @attrs: the worker attributes
+ *
+ * Look up the unbound gcwq whose workers have @attrs and take a reference
+ * on it.  If there is none, set up one which is unused, or else a new
+ * one, with the initial worker of each of its pools.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_attrs_mutex).  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * The gcwq on success, ERR_PTR() value on failure.
+ */
+static struct global_cwq *get_unbound_gcwq(const struct workqueue_attrs *attrs)
+{
+	struct worker *workers[NR_WORKER_POOLS] = { };
+	struct global_cwq *gcwq = &unbound_global_cwq;
+	struct worker_pool *pool;
+	unsigned int i;
+
+	lockdep_assert_held(&wq_attrs_mutex);
+
+	if (wq_attrs_equal(attrs, gcwq->attrs))
+		return gcwq;
+
+	gcwq = NULL;
+	for (i = 0; i < nr_attrs_gcwqs; i++) {
+		struct global_cwq *g = attrs_gcwqs[i];
+
+		if (g->refcnt > 0 && wq_attrs_equal(attrs, g->attrs)) {
+			g->refcnt++;
+			return g;
+		}
+		if (g->refcnt < 0 && !gcwq)
+			gcwq = g;
+	}
+
+	if (!gcwq) {
+		gcwq = alloc_unbound_gcwq(attrs->node);
+		if (IS_ERR(gcwq))
+			return gcwq;
+	}
+
+	copy_workqueue_attrs(gcwq->attrs, attrs);
+
+	for_each_worker_pool(pool, gcwq) {
+		workers[worker_pool_pri(pool)] = create_worker(pool);
+		if (!workers[worker_pool_pri(pool)])
+			goto fail;
+	}
+
+	spin_lock_irq(&gcwq->lock);
+	for_each_worker_pool(pool, gcwq)
+		start_worker(workers[worker_pool_pri(pool)]);
+	spin_unlock_irq(&gcwq->lock);
+
+	gcwq->refcnt = 1;
+	return gcwq;
+fail:
+	/* the gcwq stays around, unused */
+	for (i = 0; i < NR_WORKER_POOLS; i++) {
+		struct worker *worker = workers[i];
+
+		if (!worker)
+			continue;
+		kthread_stop(worker->task);
+		spin_lock_irq(&gcwq->lock);
+		ida_remove(&worker->pool->worker_ida, worker->id);
+		spin_unlock_irq(&gcwq->lock);
+		kfree(worker);
+	}
+	return ERR_PTR(-ENOMEM);
+}
+
+/*
+ * Drop a reference taken by get_unbound_gcwq().  The workers of a gcwq
+ * which isn't used any more are destroyed from system_wq.
+ */
+static void put_unbound_gcwq(struct global_cwq *gcwq)
+{
+	lockdep_assert_held(&wq_attrs_mutex);
+
+	if (gcwq != &unbound_global_cwq && !--gcwq->refcnt)
+		schedule_work(&gcwq->release_work);
+}
+
+/**
+ * move_unbound_cwq - move the cwq of an unbound workqueue to another gcwq
+ * @cwq: cwq of the unbound workqueue
+ * @gcwq: the new gcwq
+ *
+ * The counters of a cwq are protected by the lock of the gcwq serving
+ * it, so its work items can't be spread over two gcwqs.  Hold back new
+ * work items on ->delayed_works as freezing does, see cwq_max_active(),
+ * and switch once the active ones have finished on the old gcwq, which
+ * cwq_dec_nr_in_flight() wakes us up for.  wq_attrs_mutex is released
+ * meanwhile.  Give up after MOVE_TIMEOUT, as an active work item may be
+ * waiting for one held back.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_attrs_mutex), which is released and regrabbed.
+ *
+ * RETURNS:
+ * 0 on success, -EBUSY if @cwq is already being moved or the active work
+ * items didn't go away in time.
+ */
+static int move_unbound_cwq(struct cpu_workqueue_struct *cwq,
+			    struct global_cwq *gcwq)
+{
+	struct global_cwq *old_gcwq = cwq->pool->gcwq;
+	int ret = 0;
+
+	lockdep_assert_held(&wq_attrs_mutex);
+
+	if (cwq->move_to)
+		return -EBUSY;
+	if (gcwq == old_gcwq)
+		return 0;
+
+	spin_lock(&workqueue_lock);
+	spin_lock_irq(&old_gcwq->lock);
+	cwq->move_to = gcwq;
+	cwq->max_active = 0;
+	spin_unlock_irq(&old_gcwq->lock);
+	spin_unlock(&workqueue_lock);
+
+	mutex_unlock(&wq_attrs_mutex);
+	wait_event_timeout(wq_move_wait, !ACCESS_ONCE(cwq->nr_active),
+			   MOVE_TIMEOUT);
+	mutex_lock(&wq_attrs_mutex);
+
+	spin_lock(&workqueue_lock);
+	spin_lock_irq(&old_gcwq->lock);
+
+	cwq->move_to = NULL;
+	if (!cwq->nr_active) {
+		cwq->pool = &gcwq->pools[worker_pool_pri(cwq->pool)];
+		spin_unlock(&old_gcwq->lock);
+		spin_lock(&gcwq->lock);
+	} else {
+		gcwq = old_gcwq;
+		ret = -EBUSY;
+	}
+
+	/* restore max_active and release the held back work items */
+	cwq->max_active = cwq_max_active(cwq);
+
+	while (!list_empty(&cwq->delayed_works) &&
+	       cwq->nr_active < cwq->max_active)
+		cwq_activate_first_delayed(cwq);
+
+	wake_up_worker(cwq->pool);
+
+	spin_unlock_irq(&gcwq->lock);
+	spin_unlock(&workqueue_lock);
+	return ret;
+}
+
+/**
+ * apply_workqueue_attrs - apply new worker attributes to a workqueue
+ * @wq: the target unbound workqueue
+ * @attrs: the worker attributes to apply
+ *
+ * Have the work items of @wq executed by workers with @attrs from now on.
+ * Unbound workqueues with equal attributes share an unbound gcwq, which
+ * is created on the first use of the attributes.  If @attrs->node is
+ * set, the workers are further confined to the CPUs of that node.
+ *
+ * Work items of @wq which are already executing are waited for, see
+ * move_unbound_cwq().
+ *
+ * CONTEXT:
+ * Might sleep.
+ *
+ * RETURNS:
+ * 0 on success, -errno on failure.
+ */
+int apply_workqueue_attrs(struct workqueue_struct *wq,
+			  const struct workqueue_attrs *attrs)
+{
+	struct workqueue_attrs *new_attrs;
+	struct global_cwq *gcwq, *old_gcwq;
+	int ret;
+
+	if (WARN_ON(!(wq->flags & WQ_UNBOUND)))
+		return -EINVAL;
+
+	if (attrs->nice < -20 || attrs->nice > 19)
+		return -EINVAL;
+	if (attrs->node != NUMA_NO_NODE &&
+	    (attrs->node < 0 || attrs->node >= nr_node_ids ||
+	     !node_online(attrs->node)))
+		return -EINVAL;
+
+	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!new_attrs)
+		return -ENOMEM;
+
+	copy_workqueue_attrs(new_attrs, attrs);
+	cpumask_and(new_attrs->cpumask, new_attrs->cpumask,
+		    cpu_possible_mask);
+	if (new_attrs->node != NUMA_NO_NODE)
+		cpumask_and(new_attrs->cpumask, new_attrs->cpumask,
+			    cpumask_of_node(new_attrs->node));
+
+	ret = -EINVAL;
+	if (cpumask_empty(new_attrs->cpumask))
+		goto out_free;
+
+	mutex_lock(&wq_attrs_mutex);
+	gcwq = get_unbound_gcwq(new_attrs);
+	if (IS_ERR(gcwq)) {
+		ret = PTR_ERR(gcwq);
+	} else {
+		old_gcwq = wq->cpu_wq.single->pool->gcwq;
+		ret = move_unbound_cwq(wq->cpu_wq.single, gcwq);
+		put_unbound_gcwq(ret ? gcwq : old_gcwq);
+	}
+	mutex_unlock(&wq_attrs_mutex);
+out_free:
+	free_workqueue_attrs(new_attrs);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(apply_workqueue_attrs);
+
+#ifdef CONFIG_SYSFS
+/*
+ * Workqueues with WQ_SYSFS are visible to userland under
+ * /sys/bus/workqueue/devices/WQ_NAME.  All of them have
+ *
+ *  per_cpu	RO bool	: whether the workqueue is per-cpu or unbound
+ *  max_active	RW int	: maximum number of active work items
+ *
+ * and unbound ones also have the attributes of their workers
+ *
+ *  nice	RW int	: nice level
+ *  cpumask	RW mask	: allowed CPUs
+ *  numa_node	RW int	: NUMA node, -1 for none.  Writing it resets
+ *			  cpumask to the CPUs of the node.
+ */
+struct wq_device {
+	struct workqueue_struct		*wq;
+	struct device			dev;
+};
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	struct wq_device *wq_dev = container_of(dev, struct wq_device, dev);
+
+	return wq_dev->wq;
+}
+
+/* the attributes of unbound @wq, wq_attrs_mutex must be held */
+static struct workqueue_attrs *wq_unbound_attrs(struct workqueue_struct *wq)
+{
+	return wq->cpu_wq.single->pool->gcwq->attrs;
+}
+
+/* make a copy of the attributes of @wq to modify and apply */
+static struct workqueue_attrs *wq_sysfs_prep_attrs(struct workqueue_struct *wq)
+{
+	struct workqueue_attrs *attrs;
+
+	attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!attrs)
+		return NULL;
+
+	mutex_lock(&wq_attrs_mutex);
+	copy_workqueue_attrs(attrs, wq_unbound_attrs(wq));
+	mutex_unlock(&wq_attrs_mutex);
+	return attrs;
+}
+
+static ssize_t wq_per_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", !(wq->flags & WQ_UNBOUND));
+}
+
+static ssize_t wq_max_active_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", wq->saved_max_active);
+}
+
+static ssize_t wq_max_active_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int val;
+
+	if (sscanf(buf, "%d", &val) != 1 || val <= 0)
+		return -EINVAL;
+
+	workqueue_set_max_active(wq, val);
+	return count;
+}
+
+static ssize_t wq_nice_show(struct device *dev,
+			    struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	ssize_t written;
+
+	mutex_lock(&wq_attrs_mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n", wq_unbound_attrs(wq)->nice);
+	mutex_unlock(&wq_attrs_mutex);
+	return written;
+}
+
+static ssize_t wq_nice_store(struct device *dev,
+			     struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret = -EINVAL;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	if (sscanf(buf, "%d", &attrs->nice) == 1)
+		ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_cpumask_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	ssize_t written;
+
+	mutex_lock(&wq_attrs_mutex);
+	written = cpumask_scnprintf(buf, PAGE_SIZE,
+				    wq_unbound_attrs(wq)->cpumask);
+	mutex_unlock(&wq_attrs_mutex);
+
+	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
+	return written;
+}
+
+static ssize_t wq_cpumask_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(attrs->cpumask),
+			   nr_cpumask_bits);
+	if (!ret)
+		ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_numa_node_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	ssize_t written;
+
+	mutex_lock(&wq_attrs_mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n", wq_unbound_attrs(wq)->node);
+	mutex_unlock(&wq_attrs_mutex);
+	return written;
+}
+
+static ssize_t wq_numa_node_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret = -EINVAL;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	if (sscanf(buf, "%d", &attrs->node) == 1) {
+		/* start over from all CPUs, the old node restricted them */
+		cpumask_copy(attrs->cpumask, cpu_possible_mask);
+		ret = apply_workqueue_attrs(wq, attrs);
+	}
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(per_cpu, 0444, wq_per_cpu_show, NULL),
+	__ATTR(max_active, 0644, wq_max_active_show, wq_max_active_store),
+	__ATTR_NULL,
+};
+
+static struct device_attribute wq_sysfs_unbound_attrs[] = {
+	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
+	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
+	__ATTR(numa_node, 0644, wq_numa_node_show, wq_numa_node_store),
+	__ATTR_NULL,
+};
+
+static struct bus_type wq_subsys = {
+	.name				= "workqueue",
+	.dev_attrs			= wq_sysfs_attrs,
+};
+
+static void wq_device_release(struct device *dev)
+{
+	kfree(container_of(dev, struct wq_device, dev));
+}
+
+/**
+ * workqueue_sysfs_register - make a workqueue visible in sysfs
+ * @wq: the workqueue to register
+ *
+ * Expose @wq under /sys/bus/workqueue/devices.  Called for workqueues
+ * created with WQ_SYSFS.  Those created before the workqueue subsystem
+ * is registered are taken care of by wq_sysfs_init().
+ *
+ * RETURNS:
+ * 0 on success, -errno on failure.
+ */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	int ret;
+
+	if (!wq_subsys.dev_root)
+		return 0;
+
+	wq->wq_dev = wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev)
+		return -ENOMEM;
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_subsys;
+	wq_dev->dev.init_name = wq->name;
+	wq_dev->dev.release = wq_device_release;
+
+	/* announce it once the attributes of unbound wqs are there too */
+	dev_set_uevent_suppress(&wq_dev->dev, true);
+
+	ret = device_register(&wq_dev->dev);
+	if (ret) {
+		put_device(&wq_dev->dev);
+		wq->wq_dev = NULL;
+		return ret;
+	}
+
+	if (wq->flags & WQ_UNBOUND) {
+		struct device_attribute *attr;
+
+		for (attr = wq_sysfs_unbound_attrs; attr->attr.name; attr++) {
+			ret = device_create_file(&wq_dev->dev, attr);
+			if (ret) {
+				device_unregister(&wq_dev->dev);
+				wq->wq_dev = NULL;
+				return ret;
+			}
+		}
+	}
+
+	dev_set_uevent_suppress(&wq_dev->dev, false);
+	kobject_uevent(&wq_dev->dev.kobj, KOBJ_ADD);
+	return 0;
+}
+
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev = wq->wq_dev;
+
+	if (!wq_dev)
+		return;
+
+	wq->wq_dev = NULL;
+	device_unregister(&wq_dev->dev);
+}
+
+static int __init wq_sysfs_init(void)
+{
+	int ret;
+
+	ret = subsys_system_register(&wq_subsys, NULL);
+	if (ret)
+		return ret;
+
+	/* created by init_workqueues() before the subsystem existed */
+	return workqueue_sysfs_register(system_unbound_wq);
+}
+core_initcall(wq_sysfs_init);
+#else	/* CONFIG_SYSFS */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)
+{
+	return 0;
+}
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq) { }
+#endif	/* CONFIG_SYSFS */
+
 static int alloc_cwqs(struct workqueue_struct *wq)
 {
 	/*
@@ -3284,6 +4123,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 	spin_unlock(&workqueue_lock);
 
+	if (wq->flags & WQ_SYSFS && workqueue_sysfs_register(wq))
+		goto err_destroy;
+
 	return wq;
 err:
 	if (wq) {
@@ -3293,6 +4135,9 @@ err:
 		kfree(wq);
 	}
 	return NULL;
+err_destroy:
+	destroy_workqueue(wq);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
 
@@ -3306,6 +4151,8 @@ void destroy_workqueue(struct workqueue_struct *wq)
 {
 	unsigned int cpu;
 
+	workqueue_sysfs_unregister(wq);
+
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
 
@@ -3328,6 +4175,13 @@ void destroy_workqueue(struct workqueue_struct *wq)
 		BUG_ON(!list_empty(&cwq->delayed_works));
 	}
 
+	/* let go of the gcwq with attributes it may use */
+	if (wq->flags & WQ_UNBOUND) {
+		mutex_lock(&wq_attrs_mutex);
+		put_unbound_gcwq(wq->cpu_wq.single->pool->gcwq);
+		mutex_unlock(&wq_attrs_mutex);
+	}
+
 	if (wq->flags & WQ_RESCUER) {
 		kthread_stop(wq->rescuer->task);
 		free_mayday_mask(wq->mayday_mask);
@@ -3360,15 +4214,13 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 	wq->saved_max_active = max_active;
 
 	for_each_cwq_cpu(cpu, wq) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-
-		spin_lock_irq(&gcwq->lock);
-
-		if (!(wq->flags & WQ_FREEZABLE) ||
-		    !(gcwq->flags & GCWQ_FREEZING))
-			get_cwq(gcwq->cpu, wq)->max_active = max_active;
+		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		struct global_cwq *gcwq;
+		unsigned long flags;
 
-		spin_unlock_irq(&gcwq->lock);
+		gcwq = lock_cwq_gcwq(cwq, &flags);
+		cwq->max_active = cwq_max_active(cwq);
+		spin_unlock_irqrestore(&gcwq->lock, flags);
 	}
 
 	spin_unlock(&workqueue_lock);
@@ -3400,13 +4252,16 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  * @work: the work of interest
  *
  * RETURNS:
- * CPU number if @work was ever queued.  WORK_CPU_NONE otherwise.
+ * CPU number if @work was ever queued, WORK_CPU_UNBOUND if it was queued
+ * on an unbound workqueue.  WORK_CPU_NONE otherwise.
  */
 unsigned int work_cpu(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_work_gcwq(work);
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	if (!gcwq)
+		return WORK_CPU_NONE;
+	return min_t(unsigned int, gcwq->cpu, WORK_CPU_UNBOUND);
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3663,7 +4518,7 @@ void freeze_workqueues_begin(void)
 		gcwq->flags |= GCWQ_FREEZING;
 
 		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct cpu_workqueue_struct *cwq = get_gcwq_cwq(gcwq, wq);
 
 			if (cwq && wq->flags & WQ_FREEZABLE)
 				cwq->max_active = 0;
@@ -3698,13 +4553,14 @@ bool freeze_workqueues_busy(void)
 	BUG_ON(!workqueue_freezing);
 
 	for_each_gcwq_cpu(cpu) {
+		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct workqueue_struct *wq;
 		/*
 		 * nr_active is monotonically decreasing.  It's safe
 		 * to peek without lock.
 		 */
 		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct cpu_workqueue_struct *cwq = get_gcwq_cwq(gcwq, wq);
 
 			if (!cwq || !(wq->flags & WQ_FREEZABLE))
 				continue;
@@ -3750,13 +4606,13 @@ void thaw_workqueues(void)
 		gcwq->flags &= ~GCWQ_FREEZING;
 
 		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+			struct cpu_workqueue_struct *cwq = get_gcwq_cwq(gcwq, wq);
 
 			if (!cwq || !(wq->flags & WQ_FREEZABLE))
 				continue;
 
 			/* restore max_active and repopulate worklist */
-			cwq->max_active = wq->saved_max_active;
+			cwq->max_active = cwq_max_active(cwq);
 
 			while (!list_empty(&cwq->delayed_works) &&
 			       cwq->nr_active < cwq->max_active)
@@ -3778,41 +4634,20 @@ out_unlock:
 static int __init init_workqueues(void)
 {
 	unsigned int cpu;
-	int i;
+
+	/* unbound gcwq ids must fit in work->data */
+	BUILD_BUG_ON(WQ_ATTRS_GCWQ_BASE + WQ_MAX_ATTRS_GCWQS - 1 >
+		     (~0UL >> WORK_STRUCT_FLAG_BITS));
 
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
 	/* initialize gcwqs */
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct worker_pool *pool;
-
-		spin_lock_init(&gcwq->lock);
-		gcwq->cpu = cpu;
-		gcwq->flags |= GCWQ_DISASSOCIATED;
-
-		for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
-			INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
-
-		for_each_worker_pool(pool, gcwq) {
-			pool->gcwq = gcwq;
-			INIT_LIST_HEAD(&pool->worklist);
-			INIT_LIST_HEAD(&pool->idle_list);
-
-			init_timer_deferrable(&pool->idle_timer);
-			pool->idle_timer.function = idle_worker_timeout;
-			pool->idle_timer.data = (unsigned long)pool;
-
-			setup_timer(&pool->mayday_timer, gcwq_mayday_timeout,
-				    (unsigned long)pool);
-
-			mutex_init(&pool->manager_mutex);
-			ida_init(&pool->worker_ida);
-		}
+	for_each_gcwq_cpu(cpu)
+		init_gcwq(get_gcwq(cpu), cpu);
 
-		init_waitqueue_head(&gcwq->rebind_hold);
-	}
+	unbound_global_cwq.attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	BUG_ON(!unbound_global_cwq.attrs);
 
 	/* create the initial worker */
 	for_each_online_gcwq_cpu(cpu) {
@@ -3836,7 +4671,8 @@ static int __init init_workqueues(void)
 	system_wq = alloc_workqueue("events", 0, 0);
 	system_long_wq = alloc_workqueue("events_long", 0, 0);
 	system_nrt_wq = alloc_workqueue("events_nrt", WQ_NON_REENTRANT, 0);
-	system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND,
+	system_unbound_wq = alloc_workqueue("events_unbound",
+					    WQ_UNBOUND | WQ_SYSFS,
 					    WQ_UNBOUND_MAX_ACTIVE);
 	system_freezable_wq = alloc_workqueue("events_freezable",
 					      WQ_FREEZABLE, 0);
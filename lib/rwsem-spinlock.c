@@ -46,6 +46,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->activity = 0;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 }
 EXPORT_SYMBOL(__init_rwsem);
 
@@ -202,6 +205,56 @@ int __down_read_trylock(struct rw_semaphore *sem)
 	return ret;
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Optimistic spinning, as in __mutex_lock_common(): while the writer
+ * holding the semaphore runs, it is likely to release it soon, and
+ * spinning for it saves the two context switches of sleeping.  Readers
+ * are not tracked, so don't spin on a semaphore held for reading.  The
+ * semaphore is handed over to the waiters in order, so don't spin
+ * either once there are some.
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	int taken = 0;
+
+	preempt_disable();
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED ||
+		    !list_empty(&sem->wait_list))
+			break;
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (!ACCESS_ONCE(sem->activity) && __down_write_trylock(sem)) {
+			taken = 1;
+			break;
+		}
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the semaphore and setting the owner field.
+		 * If we're an RT task that will live-lock because we won't
+		 * let the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	preempt_enable();
+
+	return taken;
+}
+#else
+static inline int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	return 0;
+}
+#endif
+
 /*
  * get a write lock on the semaphore
  * - we increment the waiting count anyway to indicate an exclusive lock
@@ -212,6 +265,9 @@ void __sched __down_write_nested(struct rw_semaphore *sem, int subclass)
 	struct task_struct *tsk;
 	unsigned long flags;
 
+	if (rwsem_optimistic_spin(sem))
+		goto out;
+
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	if (sem->activity == 0 && list_empty(&sem->wait_list)) {
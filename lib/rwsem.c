@@ -24,6 +24,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -36,13 +39,16 @@ struct rwsem_waiter {
 #define RWSEM_WAITING_FOR_WRITE	0x00000002
 };
 
-/* Wake types for __rwsem_do_wake().  Note that RWSEM_WAKE_NO_ACTIVE and
- * RWSEM_WAKE_READ_OWNED imply that the spinlock must have been kept held
- * since the rwsem value was observed.
+/* Wake types for __rwsem_do_wake().  Note that RWSEM_WAKE_NO_ACTIVE
+ * implies that the spinlock must have been kept held since the rwsem value
+ * was observed.  RWSEM_WAKE_READ_OWNED is only for rwsem_downgrade_wake():
+ * a writer spinning in rwsem_optimistic_spin() may take the sem as soon as
+ * its readers leave, so having seen it read owned earlier proves nothing.
  */
 #define RWSEM_WAKE_ANY        0 /* Wake whatever's at head of wait list */
 #define RWSEM_WAKE_NO_ACTIVE  1 /* rwsem was observed with no active thread */
-#define RWSEM_WAKE_READ_OWNED 2 /* rwsem was observed to be read owned */
+#define RWSEM_WAKE_READ_OWNED 2 /* rwsem is read owned by the caller */
+#define RWSEM_WAKE_READERS    3 /* Wake readers only */
 
 /*
  * handle the lock release when processes blocked on it that can now run
@@ -66,7 +72,8 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	if (!(waiter->flags & RWSEM_WAITING_FOR_WRITE))
 		goto readers_only;
 
-	if (wake_type == RWSEM_WAKE_READ_OWNED)
+	if (wake_type == RWSEM_WAKE_READ_OWNED ||
+	    wake_type == RWSEM_WAKE_READERS)
 		/* Another active reader was observed, so wakeup is not
 		 * likely to succeed. Save the atomic op.
 		 */
@@ -99,24 +106,28 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	goto out;
 
  readers_only:
-	/* If we come here from up_xxxx(), another thread might have reached
-	 * rwsem_down_failed_common() before we acquired the spinlock and
-	 * woken up a waiter, making it now active.  We prefer to check for
-	 * this first in order to not spend too much time with the spinlock
-	 * held if we're not going to be able to wake up readers in the end.
-	 *
-	 * Note that we do not need to update the rwsem count: any writer
-	 * trying to acquire rwsem will run rwsem_down_write_failed() due
-	 * to the waiting threads and block trying to acquire the spinlock.
-	 *
-	 * We use a dummy atomic update in order to acquire the cache line
-	 * exclusively since we expect to succeed and run the final rwsem
-	 * count adjustment pretty soon.
+	/* Unless the caller holds a read lock, a writer may have taken
+	 * it before we could grant it to the readers: another thread may
+	 * have reached rwsem_down_failed_common() and been woken, or a
+	 * writer may have stolen it while spinning in
+	 * rwsem_optimistic_spin().  So grant a first read lock, which
+	 * makes a writer fail to steal it from now on, and back off if a
+	 * writer was already active.
 	 */
-	if (wake_type == RWSEM_WAKE_ANY &&
-	    rwsem_atomic_update(0, sem) < RWSEM_WAITING_BIAS)
-		/* Someone grabbed the sem for write already */
-		goto out;
+	adjustment = 0;
+	if (wake_type != RWSEM_WAKE_READ_OWNED) {
+		adjustment = RWSEM_ACTIVE_READ_BIAS;
+ try_reader_grant:
+		oldcount = rwsem_atomic_update(adjustment, sem) - adjustment;
+		if (unlikely(oldcount < RWSEM_WAITING_BIAS)) {
+			/* A writer got the sem, undo our reader grant */
+			if (rwsem_atomic_update(-adjustment, sem) &
+			    RWSEM_ACTIVE_MASK)
+				goto out;
+			/* the last active locker left meanwhile, retry */
+			goto try_reader_grant;
+		}
+	}
 
 	/* Grant an infinite number of read locks to the readers at the front
 	 * of the queue.  Note we increment the 'active part' of the count by
@@ -134,12 +145,13 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 
 	} while (waiter->flags & RWSEM_WAITING_FOR_READ);
 
-	adjustment = woken * RWSEM_ACTIVE_READ_BIAS;
+	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
 	if (waiter->flags & RWSEM_WAITING_FOR_READ)
 		/* hit end of list above */
 		adjustment -= RWSEM_WAITING_BIAS;
 
-	rwsem_atomic_add(adjustment, sem);
+	if (adjustment)
+		rwsem_atomic_add(adjustment, sem);
 
 	next = sem->wait_list.next;
 	for (loop = woken; loop > 0; loop--) {
@@ -176,6 +188,7 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
 	signed long count;
+	bool waiting = true; /* any queued threads before us */
 
 	set_task_state(tsk, TASK_UNINTERRUPTIBLE);
 
@@ -185,8 +198,10 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	waiter.flags = flags;
 	get_task_struct(tsk);
 
-	if (list_empty(&sem->wait_list))
+	if (list_empty(&sem->wait_list)) {
 		adjustment += RWSEM_WAITING_BIAS;
+		waiting = false;
+	}
 	list_add_tail(&waiter.list, &sem->wait_list);
 
 	/* we're now waiting on the lock, but no longer actively locking */
@@ -196,13 +211,15 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	 *
 	 * Alternatively, if we're called from a failed down_write(), there
 	 * were already threads queued before us and there are no active
-	 * writers, the lock must be read owned; so we try to wake any read
-	 * locks that were queued ahead of us. */
+	 * writers, the lock was read owned; so we try to wake any read
+	 * locks that were queued ahead of us.  The readers may have left
+	 * and a spinning writer taken the lock since, so __rwsem_do_wake()
+	 * must check for that before granting them the lock. */
 	if (count == RWSEM_WAITING_BIAS)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_NO_ACTIVE);
-	else if (count > RWSEM_WAITING_BIAS &&
-		 adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
+	else if (count > RWSEM_WAITING_BIAS && waiting &&
+		 (flags & RWSEM_WAITING_FOR_WRITE))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
 
@@ -228,13 +245,88 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 					-RWSEM_ACTIVE_READ_BIAS);
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Try to take the write lock without queueing.  This can steal the sem
+ * from the waiters, which is fine: whoever holds it wakes them up when
+ * releasing it.
+ */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	for (;;) {
+		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
+			return 0;
+
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+
+		count = old;
+	}
+}
+
+/*
+ * Optimistic spinning, as in __mutex_lock_common(): while the writer
+ * holding the sem runs, it is likely to release it soon, and spinning
+ * for it saves the two context switches of sleeping.  Readers are not
+ * tracked, so don't spin on a sem held for reading; the spin is bounded
+ * by the owner running and by need_resched().
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	int taken = 0;
+
+	preempt_disable();
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED)
+			break;
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = 1;
+			break;
+		}
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the sem and setting the owner field. If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	preempt_enable();
+
+	return taken;
+}
+#else
+static inline int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	return 0;
+}
+#endif
+
 /*
  * wait for the write lock to be granted
  */
 struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 {
-	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE,
-					-RWSEM_ACTIVE_WRITE_BIAS);
+	/* undo write bias from down_write operation, stop active locking */
+	rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+
+	if (rwsem_optimistic_spin(sem))
+		return sem;
+
+	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE, 0);
 }
 
 /*
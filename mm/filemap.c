@@ -491,6 +491,120 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+/*
+ * Insert a run of new pages with consecutive indices into the page cache
+ * under a single tree_lock hold.  A run of PAGEVEC_SIZE pages spans at
+ * most two radix tree leaf nodes, which one radix_tree_preload() covers.
+ */
+static unsigned __add_to_page_cache_run(struct address_space *mapping,
+					struct pagevec *pvec, gfp_t gfp_mask)
+{
+	unsigned nr = pagevec_count(pvec);
+	unsigned long charged = 0, added = 0;
+	struct pagevec lru_pvec;
+	unsigned i, nr_added = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		VM_BUG_ON(PageSwapBacked(page));
+		__set_page_locked(page);
+		if (!mem_cgroup_cache_charge(page, current->mm,
+					     gfp_mask & GFP_RECLAIM_MASK))
+			charged |= 1UL << i;
+	}
+
+	if (charged && !radix_tree_preload(gfp_mask & ~__GFP_HIGHMEM)) {
+		spin_lock_irq(&mapping->tree_lock);
+		for (i = 0; i < nr; i++) {
+			struct page *page = pvec->pages[i];
+
+			if (!(charged & (1UL << i)))
+				continue;
+			page->mapping = mapping;
+			if (unlikely(radix_tree_insert(&mapping->page_tree,
+						       page->index, page))) {
+				page->mapping = NULL;
+				continue;
+			}
+			page_cache_get(page);
+			mapping->nrpages++;
+			__inc_zone_page_state(page, NR_FILE_PAGES);
+			added |= 1UL << i;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		radix_tree_preload_end();
+	}
+
+	pagevec_init(&lru_pvec, 0);
+	for (i = 0; i < nr; i++) {
+		struct page *page = pvec->pages[i];
+
+		if (!(added & (1UL << i))) {
+			if (charged & (1UL << i))
+				mem_cgroup_uncharge_cache_page(page);
+			__clear_page_locked(page);
+			continue;
+		}
+		/* the LRU pagevec drops this reference */
+		page_cache_get(page);
+		pagevec_add(&lru_pvec, page);
+		nr_added++;
+	}
+	pagevec_lru_add_file(&lru_pvec);
+
+	return nr_added;
+}
+
+/**
+ * add_to_page_cache_lru_list - add a list of new pages to the pagecache
+ * @mapping:	the address_space to add the pages to
+ * @pages:	list of new pages, linked through page->lru
+ * @gfp_mask:	page allocation mode
+ *
+ * The pages are walked from the tail of @pages, in the order the
+ * ->readpages() implementations consume them, and inserted at their
+ * page->index.  Runs of consecutive indices are inserted under one
+ * tree_lock hold instead of one per page.
+ *
+ * Pages that were added are locked and on their way to the LRU, as after
+ * add_to_page_cache_lru().  Pages that could not be added, because another
+ * page is already cached at their index or memory ran short, are left
+ * unlocked.  The pages stay on @pages and the caller keeps its reference.
+ *
+ * Returns the number of pages added.
+ */
+unsigned add_to_page_cache_lru_list(struct address_space *mapping,
+				    struct list_head *pages, gfp_t gfp_mask)
+{
+	struct pagevec pvec;
+	struct page *page;
+	unsigned nr_added = 0;
+
+	BUILD_BUG_ON(PAGEVEC_SIZE > BITS_PER_LONG);
+
+	pagevec_init(&pvec, 0);
+	list_for_each_entry_reverse(page, pages, lru) {
+		unsigned nr = pagevec_count(&pvec);
+
+		if (nr && page->index != pvec.pages[nr - 1]->index + 1) {
+			nr_added += __add_to_page_cache_run(mapping, &pvec,
+							    gfp_mask);
+			pagevec_reinit(&pvec);
+		}
+		if (!pagevec_add(&pvec, page)) {
+			nr_added += __add_to_page_cache_run(mapping, &pvec,
+							    gfp_mask);
+			pagevec_reinit(&pvec);
+		}
+	}
+	if (pagevec_count(&pvec))
+		nr_added += __add_to_page_cache_run(mapping, &pvec, gfp_mask);
+
+	return nr_added;
+}
+EXPORT_SYMBOL_GPL(add_to_page_cache_lru_list);
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
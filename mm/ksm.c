@@ -895,6 +895,13 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 			 */
 			set_page_stable_node(page, NULL);
 			mark_page_accessed(page);
+			/*
+			 * Its ptes are clean now, so make sure a page freed
+			 * with MADV_FREE isn't dropped by reclaim while other
+			 * mappings come to depend on its contents.
+			 */
+			if (!PageDirty(page))
+				SetPageDirty(page);
 			err = 0;
 		} else if (pages_identical(page, kpage))
 			err = replace_page(vma, page, kpage, orig_pte);
@@ -103,6 +103,9 @@ enum mem_cgroup_events_index {
 	MEM_CGROUP_EVENTS_PGPGOUT,	/* # of pages paged out */
 	MEM_CGROUP_EVENTS_PGFAULT,	/* # of page-faults */
 	MEM_CGROUP_EVENTS_PGMAJFAULT,	/* # of major page-faults */
+	MEM_CGROUP_EVENTS_PGSCAN,	/* # of pages scanned by reclaim */
+	MEM_CGROUP_EVENTS_PGSTEAL,	/* # of pages reclaimed */
+	MEM_CGROUP_EVENTS_PGSTEAL_SOFT,	/* # reclaimed over the soft limit */
 	MEM_CGROUP_EVENTS_NSTATS,
 };
 
@@ -111,6 +114,9 @@ static const char * const mem_cgroup_events_names[] = {
 	"pgpgout",
 	"pgfault",
 	"pgmajfault",
+	"pgscan",
+	"pgsteal",
+	"pgsteal_soft",
 };
 
 /*
@@ -666,6 +672,21 @@ mem_cgroup_largest_soft_limit_node(struct mem_cgroup_tree_per_zone *mctz)
 	return mz;
 }
 
+void mem_cgroup_account_reclaim(struct mem_cgroup *memcg,
+				unsigned long nr_scanned,
+				unsigned long nr_reclaimed, bool soft)
+{
+	if (!memcg)
+		return;
+
+	this_cpu_add(memcg->stat->events[MEM_CGROUP_EVENTS_PGSCAN], nr_scanned);
+	this_cpu_add(memcg->stat->events[MEM_CGROUP_EVENTS_PGSTEAL],
+		     nr_reclaimed);
+	if (soft)
+		this_cpu_add(memcg->stat->events[MEM_CGROUP_EVENTS_PGSTEAL_SOFT],
+			     nr_reclaimed);
+}
+
 /*
  * Implementation Note: reading percpu statistics for memcg.
  *
@@ -3626,8 +3647,15 @@ static int mem_cgroup_resize_memsw_limit(struct mem_cgroup *memcg,
 	return ret;
 }
 
+/*
+ * Reclaims up to @nr_to_reclaim pages from the memory cgroups that exceed
+ * their soft limit in @zone, taking them from the soft limit tree with
+ * the largest excess first.  Each group goes back into the tree with
+ * what is left of its excess once it has been shrunk.
+ */
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 					    gfp_t gfp_mask,
+					    unsigned long nr_to_reclaim,
 					    unsigned long *total_scanned)
 {
 	unsigned long nr_reclaimed = 0;
@@ -3638,7 +3666,7 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 	unsigned long long excess;
 	unsigned long nr_scanned;
 
-	if (order > 0)
+	if (order > 0 || !nr_to_reclaim)
 		return 0;
 
 	mctz = soft_limit_tree_node_zone(zone_to_nid(zone), zone_idx(zone));
@@ -3705,14 +3733,18 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 		loop++;
 		/*
 		 * Could not reclaim anything and there are no more
-		 * mem cgroups to try or we seem to be looping without
-		 * reclaiming anything.
+		 * mem cgroups to try, we seem to be looping without
+		 * reclaiming anything, or groups keep exceeding their
+		 * soft limit as fast as we reclaim from them.
 		 */
+		if (!reclaimed && next_mz == NULL)
+			break;
 		if (!nr_reclaimed &&
-			(next_mz == NULL ||
-			loop > MEM_CGROUP_MAX_SOFT_LIMIT_RECLAIM_LOOPS))
+			loop > MEM_CGROUP_MAX_SOFT_LIMIT_RECLAIM_LOOPS)
+			break;
+		if (loop > MEM_CGROUP_MAX_RECLAIM_LOOPS)
 			break;
-	} while (!nr_reclaimed);
+	} while (nr_reclaimed < nr_to_reclaim);
 	if (next_mz)
 		css_put(&next_mz->memcg->css);
 	return nr_reclaimed;
@@ -57,6 +57,9 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/userfaultfd_k.h>
+#include <linux/prezero.h>
+#include <linux/cpuset.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -3108,6 +3111,31 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+/*
+ * The pre-zeroed pool holds pages from the local node: only use it when
+ * the task's memory policy and cpuset have no say in the placement.
+ */
+static inline struct page *prezero_anon_page(struct vm_area_struct *vma)
+{
+#ifdef CONFIG_NUMA
+	if (vma_policy(vma) || current->mempolicy ||
+	    !node_isset(numa_node_id(), cpuset_current_mems_allowed))
+		return NULL;
+#endif
+	return prezero_page_get(PREZERO_MOVABLE);
+}
+
+static inline struct page *alloc_anon_zeroed_page(struct vm_area_struct *vma,
+						  unsigned long address)
+{
+	struct page *page;
+
+	page = prezero_anon_page(vma);
+	if (!page)
+		page = alloc_zeroed_user_highpage_movable(vma, address);
+	return page;
+}
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -3127,6 +3155,10 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	if (check_stack_guard_page(vma, address) < 0)
 		return VM_FAULT_SIGBUS;
 
+	/* Let the registered userfaultfd resolve the missing page */
+	if (userfaultfd_missing(vma))
+		return handle_userfault(vma, address, flags);
+
 	/* Use the zero-page for reads */
 	if (!(flags & FAULT_FLAG_WRITE)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
@@ -3140,7 +3172,7 @@ static int do_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
-	page = alloc_zeroed_user_highpage_movable(vma, address);
+	page = alloc_anon_zeroed_page(vma, address);
 	if (!page)
 		goto oom;
 	__SetPageUptodate(page);
@@ -3514,7 +3546,8 @@ retry:
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
+	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma) &&
+	    !userfaultfd_missing(vma)) {
 		if (!vma->vm_ops)
 			return do_huge_pmd_anonymous_page(mm, vma, address,
 							  pmd, flags);
@@ -3537,6 +3570,10 @@ retry:
 				if (unlikely(ret & VM_FAULT_OOM))
 					goto retry;
 				return ret;
+			} else {
+				huge_pmd_set_accessed(mm, vma, address, pmd,
+						      orig_pmd,
+						      flags & FAULT_FLAG_WRITE);
 			}
 			return 0;
 		}
@@ -3563,6 +3600,185 @@ retry:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Snapshot the vma that covers @address without mmap_sem.  Only the vma
+ * last found by find_vma() is tried: faults tend to hit the same vma
+ * over and over, and walking the rbtree without the lock is not safe.
+ * The vma memory itself stays valid under rcu_read_lock() because vmas
+ * are freed through RCU.
+ */
+static bool spf_get_vma(struct mm_struct *mm, unsigned long address,
+			struct vm_area_struct **vmap,
+			struct vm_area_struct *copy, unsigned *seqp)
+{
+	struct vm_area_struct *vma;
+	unsigned seq;
+
+	vma = ACCESS_ONCE(mm->mmap_cache);
+	if (!vma)
+		return false;
+
+	seq = raw_seqcount_begin(&vma->vm_sequence);
+	if (seq & 1)
+		return false;
+	smp_rmb();
+	*copy = *vma;
+	if (read_seqcount_retry(&vma->vm_sequence, seq))
+		return false;
+
+	if (copy->vm_mm != mm ||
+	    address < copy->vm_start || address >= copy->vm_end)
+		return false;
+
+	*vmap = vma;
+	*seqp = seq;
+	return true;
+}
+
+/**
+ * handle_speculative_fault - handle a page fault without mmap_sem
+ * @mm: the faulting mm, which must be current->mm
+ * @address: the faulting address
+ * @flags: FAULT_FLAG_xxx flags
+ *
+ * Try to resolve a fault on a not-present pte of a private anonymous vma
+ * without taking mmap_sem, so that faulting threads do not serialize
+ * against mmap() and munmap() on unrelated parts of the address space.
+ * The vma is validated against its vm_sequence count before the new pte
+ * is made visible, with the pte lock held, so any concurrent change to
+ * the vma makes us back off.
+ *
+ * Page tables are walked with interrupts disabled, as in
+ * get_user_pages_fast(): this relies on page tables being freed only
+ * after a TLB flush IPI has been acked by every cpu running the mm.
+ *
+ * Nothing here sleeps.  Returns 0 if the fault was handled, or
+ * VM_FAULT_RETRY if the caller has to take mmap_sem and go through
+ * handle_mm_fault() instead.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma, vmas;
+	struct page *page = NULL;
+	unsigned long irqflags;
+	spinlock_t *ptl;
+	unsigned seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, pmdval;
+	pte_t *pte, entry;
+
+	rcu_read_lock();
+	if (!spf_get_vma(mm, address, &vma, &vmas, &seq))
+		goto out_unlock;
+
+	/*
+	 * Only fresh anonymous memory: anything with a ->fault handler,
+	 * stack expansion, userfaultfd or a NUMA policy of its own needs
+	 * the full fault path.  An anon_vma is not set up without mmap_sem.
+	 */
+	if (vmas.vm_ops || !vmas.anon_vma)
+		goto out_unlock;
+	if (vmas.vm_flags & (VM_SHARED | VM_HUGETLB | VM_PFNMAP |
+			     VM_MIXEDMAP | VM_GROWSDOWN | VM_GROWSUP))
+		goto out_unlock;
+	if (userfaultfd_missing(&vmas) || vma_policy(&vmas))
+		goto out_unlock;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vmas.vm_flags & VM_WRITE))
+			goto out_unlock;
+	} else if (!(vmas.vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out_unlock;
+
+	if (flags & FAULT_FLAG_WRITE) {
+		page = prezero_anon_page(&vmas);
+		if (!page) {
+			page = alloc_page((GFP_HIGHUSER_MOVABLE & ~__GFP_WAIT) |
+					  __GFP_NOWARN);
+			if (!page)
+				goto out_unlock;
+			clear_user_highpage(page, address);
+		}
+		__SetPageUptodate(page);
+
+		if (mem_cgroup_newpage_charge(page, mm, GFP_NOWAIT))
+			goto out_free;
+
+		entry = mk_pte(page, vmas.vm_page_prot);
+		entry = pte_mkwrite(pte_mkdirty(entry));
+	} else {
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address),
+					      vmas.vm_page_prot));
+	}
+
+	local_irq_save(irqflags);
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out_irq;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out_irq;
+	pmd = pmd_offset(pud, address);
+	pmdval = pmd_read_atomic(pmd);
+	barrier();
+	if (!pmd_present(pmdval) || pmd_trans_huge(pmdval) ||
+	    unlikely(pmd_bad(pmdval)))
+		goto out_irq;
+
+	ptl = pte_lockptr(mm, &pmdval);
+	if (!spin_trylock(ptl))
+		goto out_irq;
+	/*
+	 * With the pte lock held the vma cannot be unmapped under us, as
+	 * zap_pte_range() takes it: the vma is still what we copied if
+	 * its sequence count did not move.
+	 */
+	if (read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    !pmd_same(pmdval, *pmd)) {
+		spin_unlock(ptl);
+		goto out_irq;
+	}
+	pte = pte_offset_map(&pmdval, address);
+	local_irq_restore(irqflags);
+
+	if (!pte_none(*pte))
+		goto out_pte_unlock;
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, &vmas, address);
+	}
+	set_pte_at(mm, address, pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(&vmas, address, pte);
+	pte_unmap_unlock(pte, ptl);
+	rcu_read_unlock();
+
+	count_vm_event(PGFAULT);
+	count_vm_event(SPECULATIVE_PGFAULT);
+	mem_cgroup_count_vm_event(mm, PGFAULT);
+	return 0;
+
+out_pte_unlock:
+	pte_unmap_unlock(pte, ptl);
+	goto out_uncharge;
+out_irq:
+	local_irq_restore(irqflags);
+out_uncharge:
+	if (page)
+		mem_cgroup_uncharge_page(page);
+out_free:
+	if (page)
+		page_cache_release(page);
+out_unlock:
+	rcu_read_unlock();
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -0,0 +1,296 @@
+/*
+ * mm/prezero.c - per-cpu pools of pre-zeroed pages
+ *
+ * Anonymous page faults and page table allocations have to hand out
+ * zero-filled pages, and clearing them is a good part of the cost of a
+ * fault in fork/exec heavy workloads.  This keeps a small per-cpu pool
+ * of pages that were cleared ahead of time by a SCHED_IDLE kthread, so
+ * the clearing happens when the cpu would otherwise be idle.
+ *
+ * The pools are only a cache: a consumer that finds its pool empty falls
+ * back to allocating and clearing a page itself, and the pools are given
+ * back to the page allocator under memory pressure.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2. See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/highmem.h>
+#include <linux/percpu.h>
+#include <linux/cpu.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/sched.h>
+#include <linux/module.h>
+#include <linux/prezero.h>
+
+struct prezero_pool {
+	spinlock_t lock;
+	unsigned int count;
+	struct list_head pages;
+};
+
+static DEFINE_PER_CPU(struct prezero_pool [NR_PREZERO_TYPES], prezero_pools);
+
+static struct task_struct *prezero_task;
+
+static void prezero_wake(void)
+{
+	if (prezero_task)
+		wake_up_process(prezero_task);
+}
+
+/* Maximum number of pages kept in each per-cpu pool */
+static unsigned int prezero_high = 32;
+
+/* A larger pool is filled right away */
+static int prezero_set_high(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (!ret)
+		prezero_wake();
+	return ret;
+}
+
+static struct kernel_param_ops prezero_high_ops = {
+	.set = prezero_set_high,
+	.get = param_get_uint,
+};
+module_param_cb(high, &prezero_high_ops, &prezero_high, 0644);
+
+/*
+ * The pools are filled without entering reclaim or waking kswapd:
+ * clearing pages ahead of time is not worth pushing anything else out.
+ */
+static const gfp_t prezero_gfp[NR_PREZERO_TYPES] = {
+	[PREZERO_MOVABLE] = GFP_HIGHUSER_MOVABLE,
+	[PREZERO_KERNEL] = GFP_KERNEL,
+};
+#define PREZERO_GFP_FLAGS (__GFP_NOWARN | __GFP_NORETRY | \
+			   __GFP_NO_KSWAPD | __GFP_NOMEMALLOC)
+
+static inline unsigned int prezero_low(void)
+{
+	return prezero_high / 2;
+}
+
+/**
+ * prezero_page_get - take a zeroed page from this cpu's pool
+ * @type: which pool to take the page from
+ *
+ * Returns a page with a reference count of one and zeroed contents, or
+ * NULL if the pool is empty and the caller has to allocate on its own.
+ * Pages in the pools were allocated on the node of the cpu they belong
+ * to.
+ */
+struct page *prezero_page_get(enum prezero_type type)
+{
+	struct prezero_pool *pool;
+	struct page *page = NULL;
+	bool wake = false;
+
+	pool = &get_cpu_var(prezero_pools)[type];
+	spin_lock(&pool->lock);
+	if (pool->count) {
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+	}
+	/*
+	 * Ask for a refill whenever the pool is at or below the low mark,
+	 * empty included: the shrinker may have drained it below the mark.
+	 */
+	wake = pool->count <= prezero_low();
+	spin_unlock(&pool->lock);
+	put_cpu_var(prezero_pools);
+
+	if (wake)
+		prezero_wake();
+
+	return page;
+}
+
+static bool prezero_need_refill(void)
+{
+	int cpu, type;
+
+	for_each_online_cpu(cpu)
+		for (type = 0; type < NR_PREZERO_TYPES; type++)
+			if (per_cpu(prezero_pools, cpu)[type].count <
+			    prezero_high)
+				return true;
+	return false;
+}
+
+/*
+ * Top up the pool of @cpu.  Returns false if the page allocator could
+ * not give us any more pages.
+ */
+static bool prezero_refill_pool(int cpu, enum prezero_type type)
+{
+	struct prezero_pool *pool = &per_cpu(prezero_pools, cpu)[type];
+	gfp_t gfp = (prezero_gfp[type] & ~__GFP_WAIT) | PREZERO_GFP_FLAGS;
+
+	while (ACCESS_ONCE(pool->count) < prezero_high) {
+		struct page *page;
+
+		if (kthread_should_stop())
+			return false;
+
+		page = alloc_pages_node(cpu_to_node(cpu), gfp, 0);
+		if (!page)
+			return false;
+		clear_highpage(page);
+		/* the page may end up mapped to userspace */
+		flush_dcache_page(page);
+
+		spin_lock(&pool->lock);
+		if (pool->count < prezero_high) {
+			list_add(&page->lru, &pool->pages);
+			pool->count++;
+			page = NULL;
+		}
+		spin_unlock(&pool->lock);
+
+		if (page) {
+			__free_page(page);
+			break;
+		}
+		cond_resched();
+	}
+	return true;
+}
+
+static unsigned int prezero_drain_pool(struct prezero_pool *pool,
+				       unsigned int nr)
+{
+	unsigned int freed = 0;
+	LIST_HEAD(pages);
+	struct page *page, *next;
+
+	spin_lock(&pool->lock);
+	while (pool->count && freed < nr) {
+		page = list_first_entry(&pool->pages, struct page, lru);
+		list_move(&page->lru, &pages);
+		pool->count--;
+		freed++;
+	}
+	spin_unlock(&pool->lock);
+
+	list_for_each_entry_safe(page, next, &pages, lru)
+		__free_page(page);
+
+	return freed;
+}
+
+static int kprezerod(void *dummy)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	int cpu, type;
+
+	sched_setscheduler(current, SCHED_IDLE, &param);
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		bool progress = true;
+
+		get_online_cpus();
+		for_each_online_cpu(cpu)
+			for (type = 0; type < NR_PREZERO_TYPES; type++)
+				progress &= prezero_refill_pool(cpu, type);
+		put_online_cpus();
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop()) {
+			/* out of free memory: back off instead of spinning */
+			if (!progress)
+				schedule_timeout(HZ);
+			else if (!prezero_need_refill())
+				schedule();
+		}
+		__set_current_state(TASK_RUNNING);
+		try_to_freeze();
+	}
+	return 0;
+}
+
+/*
+ * Give the pools back under memory pressure.  kprezerod refills them
+ * when the next page is taken from them, without reclaim, so they only
+ * grow back when there is free memory to spare.
+ */
+static int prezero_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long nr = 0;
+	unsigned int to_scan = sc->nr_to_scan;
+	int cpu, type;
+
+	for_each_possible_cpu(cpu)
+		for (type = 0; type < NR_PREZERO_TYPES; type++) {
+			struct prezero_pool *pool;
+
+			pool = &per_cpu(prezero_pools, cpu)[type];
+			if (to_scan)
+				to_scan -= prezero_drain_pool(pool, to_scan);
+			nr += ACCESS_ONCE(pool->count);
+		}
+
+	return nr;
+}
+
+static struct shrinker prezero_shrinker = {
+	.shrink = prezero_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __cpuinit prezero_cpu_callback(struct notifier_block *nfb,
+					  unsigned long action, void *hcpu)
+{
+	int cpu = (long)hcpu;
+	int type;
+
+	switch (action) {
+	case CPU_DEAD:
+	case CPU_DEAD_FROZEN:
+		for (type = 0; type < NR_PREZERO_TYPES; type++)
+			prezero_drain_pool(&per_cpu(prezero_pools, cpu)[type],
+					   UINT_MAX);
+		break;
+	case CPU_ONLINE:
+	case CPU_ONLINE_FROZEN:
+		prezero_wake();
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static int __init prezero_init(void)
+{
+	struct task_struct *task;
+	int cpu, type;
+
+	for_each_possible_cpu(cpu)
+		for (type = 0; type < NR_PREZERO_TYPES; type++) {
+			struct prezero_pool *pool;
+
+			pool = &per_cpu(prezero_pools, cpu)[type];
+			spin_lock_init(&pool->lock);
+			INIT_LIST_HEAD(&pool->pages);
+			pool->count = 0;
+		}
+
+	hotcpu_notifier(prezero_cpu_callback, 0);
+	register_shrinker(&prezero_shrinker);
+
+	task = kthread_run(kprezerod, NULL, "kprezerod");
+	if (IS_ERR(task)) {
+		pr_err("prezero: unable to start kprezerod\n");
+		return PTR_ERR(task);
+	}
+	prezero_task = task;
+	return 0;
+}
+module_init(prezero_init)
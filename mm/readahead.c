@@ -124,13 +124,13 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 		goto out;
 	}
 
+	add_to_page_cache_lru_list(mapping, pages, GFP_KERNEL);
 	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
 		struct page *page = list_to_page(pages);
 		list_del(&page->lru);
-		if (!add_to_page_cache_lru(page, mapping,
-					page->index, GFP_KERNEL)) {
+		/* pages that made it into the page cache come back locked */
+		if (PageLocked(page))
 			mapping->a_ops->readpage(filp, page);
-		}
 		page_cache_release(page);
 	}
 	ret = 0;
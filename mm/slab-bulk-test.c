@@ -0,0 +1,100 @@
+/*
+ * mm/slab-bulk-test.c
+ *
+ * Measure the cost per object of kmem_cache_alloc()/kmem_cache_free()
+ * against kmem_cache_alloc_bulk()/kmem_cache_free_bulk(), in cycles.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "slab-bulk-test: " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <linux/sched.h>
+
+#define MAX_BULK	256
+
+static unsigned int loops = 100000;
+module_param(loops, uint, 0444);
+MODULE_PARM_DESC(loops, "Number of alloc/free rounds per bulk size");
+
+static unsigned int object_size = 256;
+module_param(object_size, uint, 0444);
+MODULE_PARM_DESC(object_size, "Size of the test objects");
+
+static const unsigned int bulk_sizes[] = { 1, 2, 4, 8, 16, 30, 32, 64, 128,
+					   MAX_BULK };
+
+static void *objs[MAX_BULK];
+
+static unsigned long long bench_single(struct kmem_cache *s, unsigned int n)
+{
+	cycles_t start, end;
+	unsigned int i, j;
+
+	start = get_cycles();
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < n; j++)
+			objs[j] = kmem_cache_alloc(s, GFP_KERNEL);
+		for (j = 0; j < n; j++)
+			kmem_cache_free(s, objs[j]);
+		cond_resched();
+	}
+	end = get_cycles();
+
+	return div64_u64(end - start, (u64)loops * n);
+}
+
+static unsigned long long bench_bulk(struct kmem_cache *s, unsigned int n)
+{
+	cycles_t start, end;
+	unsigned int i;
+
+	start = get_cycles();
+	for (i = 0; i < loops; i++) {
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, n, objs))
+			return 0;
+		kmem_cache_free_bulk(s, n, objs);
+		cond_resched();
+	}
+	end = get_cycles();
+
+	return div64_u64(end - start, (u64)loops * n);
+}
+
+static int __init slab_bulk_test_init(void)
+{
+	struct kmem_cache *s;
+	unsigned int i;
+
+	if (!loops || !object_size)
+		return -EINVAL;
+
+	s = kmem_cache_create("slab_bulk_test", object_size, 0, 0, NULL);
+	if (!s)
+		return -ENOMEM;
+
+	pr_info("%u rounds, %u byte objects, cycles per object:\n",
+		loops, object_size);
+	for (i = 0; i < ARRAY_SIZE(bulk_sizes); i++) {
+		unsigned int n = bulk_sizes[i];
+
+		pr_info("bulk %3u: single %llu, bulk %llu\n", n,
+			bench_single(s, n), bench_bulk(s, n));
+	}
+
+	kmem_cache_destroy(s);
+
+	/* nothing to keep loaded */
+	return -EAGAIN;
+}
+module_init(slab_bulk_test_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Benchmark for kmem_cache_alloc_bulk/kmem_cache_free_bulk");
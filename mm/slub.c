@@ -2618,6 +2618,99 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * The bulk functions work on the per cpu freelist with interrupts
+ * disabled instead of doing a this_cpu_cmpxchg_double() per object.  The
+ * tid is bumped before interrupts are enabled again, so that a fastpath
+ * that was interrupted on this cpu fails its cmpxchg and retries.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	local_irq_disable();
+	c = __this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = p[i];
+		struct page *page = virt_to_head_page(object);
+
+		slab_free_hook(s, object);
+
+		if (likely(page == c->page)) {
+			set_freepointer(s, object, c->freelist);
+			c->freelist = object;
+			stat(s, FREE_FASTPATH);
+		} else {
+			c->tid = next_tid(c->tid);
+			__slab_free(s, page, object, _RET_IP_);
+			c = __this_cpu_ptr(s->cpu_slab);
+		}
+		trace_kmem_cache_free(_RET_IP_, object);
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_disable();
+	c = __this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (likely(object)) {
+			c->freelist = get_freepointer(s, object);
+			stat(s, ALLOC_FASTPATH);
+		} else {
+			/*
+			 * The slowpath may enable interrupts to allocate a
+			 * new slab, and we may come back on another cpu.
+			 */
+			c->tid = next_tid(c->tid);
+			object = __slab_alloc(s, flags, NUMA_NO_NODE,
+					      _RET_IP_, c);
+			c = __this_cpu_ptr(s->cpu_slab);
+			if (unlikely(!object)) {
+				c->tid = next_tid(c->tid);
+				local_irq_enable();
+				goto error;
+			}
+		}
+		p[i] = object;
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->object_size);
+		slab_post_alloc_hook(s, flags, p[i]);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->object_size,
+				       s->size, flags);
+	}
+	return i;
+
+error:
+	/* the objects were not handed to the debug hooks yet */
+	while (i--) {
+		slab_post_alloc_hook(s, flags, p[i]);
+		kmem_cache_free(s, p[i]);
+	}
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
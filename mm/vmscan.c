@@ -773,7 +773,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
 		 */
-		if (PageAnon(page) && !PageSwapCache(page)) {
+		if (PageAnon(page) && PageSwapBacked(page) &&
+		    !PageSwapCache(page)) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
 			if (!add_to_swap(page))
@@ -785,10 +786,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 		/*
 		 * The page is mapped into the page tables of one or more
-		 * processes. Try to unmap it here.
+		 * processes. Try to unmap it here.  Pages freed with
+		 * MADV_FREE have no mapping, but can be unmapped and
+		 * dropped if they are still clean.
 		 */
-		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, TTU_UNMAP)) {
+		if (page_mapped(page) && (mapping || PageAnon(page))) {
+			switch (try_to_unmap(page, TTU_UNMAP | TTU_LZFREE)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -899,7 +902,20 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (PageAnon(page) && !PageSwapBacked(page)) {
+			/*
+			 * A clean MADV_FREE page: there is nothing to remove
+			 * it from, only make sure nobody picked up a
+			 * reference meanwhile, as __remove_mapping() does.
+			 */
+			if (!page_freeze_refs(page, 1))
+				goto keep_locked;
+			if (PageDirty(page)) {
+				page_unfreeze_refs(page, 1);
+				goto keep_locked;
+			}
+			count_vm_event(PGLAZYFREED);
+		} else if (!mapping || !__remove_mapping(mapping, page))
 			goto keep_locked;
 
 		/*
@@ -1866,8 +1882,14 @@ static void shrink_zone(struct zone *zone, struct scan_control *sc)
 	memcg = mem_cgroup_iter(root, NULL, &reclaim);
 	do {
 		struct lruvec *lruvec = mem_cgroup_zone_lruvec(zone, memcg);
+		unsigned long nr_scanned = sc->nr_scanned;
+		unsigned long nr_reclaimed = sc->nr_reclaimed;
 
 		shrink_lruvec(lruvec, sc);
+		mem_cgroup_account_reclaim(memcg,
+					   sc->nr_scanned - nr_scanned,
+					   sc->nr_reclaimed - nr_reclaimed,
+					   false);
 
 		/*
 		 * Limit reclaim has historically picked one memcg and
@@ -1950,6 +1972,7 @@ static bool shrink_zones(struct zonelist *zonelist, struct scan_control *sc)
 	struct zone *zone;
 	unsigned long nr_soft_reclaimed;
 	unsigned long nr_soft_scanned;
+	bool soft_reclaimed = false;
 	bool aborted_reclaim = false;
 
 	/*
@@ -1990,18 +2013,32 @@ static bool shrink_zones(struct zonelist *zonelist, struct scan_control *sc)
 				}
 			}
 			/*
-			 * This steals pages from memory cgroups over softlimit
-			 * and returns the number of reclaimed pages and
-			 * scanned pages. This works for global memory pressure
-			 * and balancing, not for a memcg's limit.
+			 * This steals pages from memory cgroups over softlimit,
+			 * the one with the largest excess first, and returns
+			 * the number of reclaimed pages and scanned pages. This
+			 * works for global memory pressure and balancing, not
+			 * for a memcg's limit.
 			 */
 			nr_soft_scanned = 0;
 			nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(zone,
 						sc->order, sc->gfp_mask,
+						sc->nr_to_reclaim -
+						min(sc->nr_reclaimed,
+						    sc->nr_to_reclaim),
 						&nr_soft_scanned);
 			sc->nr_reclaimed += nr_soft_reclaimed;
 			sc->nr_scanned += nr_soft_scanned;
-			/* need some check for avoid more shrink_zone() */
+			if (nr_soft_reclaimed)
+				soft_reclaimed = true;
+			/*
+			 * While the groups over their soft limit cover the
+			 * reclaim target at low priority, the groups within
+			 * their soft limits are not scanned at all.
+			 */
+			if (soft_reclaimed &&
+			    sc->nr_reclaimed >= sc->nr_to_reclaim &&
+			    sc->priority >= DEF_PRIORITY - 2)
+				continue;
 		}
 
 		shrink_zone(zone, sc);
@@ -2313,6 +2350,7 @@ unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *memcg,
 	 * the priority and make it zero.
 	 */
 	shrink_lruvec(lruvec, &sc);
+	mem_cgroup_account_reclaim(memcg, sc.nr_scanned, sc.nr_reclaimed, true);
 
 	trace_mm_vmscan_memcg_softlimit_reclaim_end(sc.nr_reclaimed);
 
@@ -2601,7 +2639,7 @@ loop_again:
 		for (i = 0; i <= end_zone; i++) {
 			struct zone *zone = pgdat->node_zones + i;
 			int nr_slab, testorder;
-			unsigned long balance_gap;
+			unsigned long balance_gap, nr_free;
 
 			if (!populated_zone(zone))
 				continue;
@@ -2612,16 +2650,6 @@ loop_again:
 
 			sc.nr_scanned = 0;
 
-			nr_soft_scanned = 0;
-			/*
-			 * Call soft limit reclaim before calling shrink_zone.
-			 */
-			nr_soft_reclaimed = mem_cgroup_soft_limit_reclaim(zone,
-							order, sc.gfp_mask,
-							&nr_soft_scanned);
-			sc.nr_reclaimed += nr_soft_reclaimed;
-			total_scanned += nr_soft_scanned;
-
 			/*
 			 * We put equal pressure on every zone, unless
 			 * one zone has way too many pages free
@@ -2634,6 +2662,25 @@ loop_again:
 				(zone->present_pages +
 					KSWAPD_ZONE_BALANCE_GAP_RATIO-1) /
 				KSWAPD_ZONE_BALANCE_GAP_RATIO);
+
+			/*
+			 * Call soft limit reclaim before calling shrink_zone,
+			 * for what the zone lacks to be balanced. If the groups
+			 * over their soft limit cover that, the watermark check
+			 * below leaves the other groups alone.
+			 */
+			nr_free = zone_page_state(zone, NR_FREE_PAGES);
+			nr_soft_scanned = 0;
+			nr_soft_reclaimed = 0;
+			if (nr_free < high_wmark_pages(zone) + balance_gap)
+				nr_soft_reclaimed =
+					mem_cgroup_soft_limit_reclaim(zone,
+						order, sc.gfp_mask,
+						high_wmark_pages(zone) +
+						balance_gap - nr_free,
+						&nr_soft_scanned);
+			sc.nr_reclaimed += nr_soft_reclaimed;
+			total_scanned += nr_soft_scanned;
 			/*
 			 * Kswapd reclaims only single pages with compaction
 			 * enabled. Trying too hard to reclaim until contiguous
@@ -3020,8 +3020,9 @@ static void net_tx_action(struct softirq_action *h)
 
 			WARN_ON(atomic_read(&skb->users));
 			trace_kfree_skb(skb, net_tx_action);
-			__kfree_skb(skb);
+			__kfree_skb_defer(skb);
 		}
+		__kfree_skb_flush();
 	}
 
 	if (sd->output_queue) {
@@ -600,6 +600,63 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+/*
+ * sk_buff shells released from softirq context are collected per cpu and
+ * handed back to skbuff_head_cache in bulk.
+ */
+#define SKB_FREE_BULK	32
+
+struct skb_free_cache {
+	unsigned int	count;
+	void		*skbs[SKB_FREE_BULK];
+};
+
+static DEFINE_PER_CPU(struct skb_free_cache, skb_free_cache);
+
+/**
+ *	__kfree_skb_flush - free the sk_buffs deferred on this cpu
+ *
+ *	Must be called from softirq context, after a batch of
+ *	__kfree_skb_defer() calls.
+ */
+void __kfree_skb_flush(void)
+{
+	struct skb_free_cache *fc = &__get_cpu_var(skb_free_cache);
+
+	if (fc->count) {
+		kmem_cache_free_bulk(skbuff_head_cache, fc->count, fc->skbs);
+		fc->count = 0;
+	}
+}
+
+/**
+ *	__kfree_skb_defer - free an sk_buff, batching the free of its shell
+ *	@skb: buffer
+ *
+ *	Like __kfree_skb(), but the sk_buff itself is only queued on a per
+ *	cpu array and freed in bulk once the array is full or on the next
+ *	__kfree_skb_flush().  Only for softirq context.
+ */
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	struct skb_free_cache *fc;
+
+	if (skb->fclone != SKB_FCLONE_UNAVAILABLE) {
+		__kfree_skb(skb);
+		return;
+	}
+
+	skb_release_all(skb);
+
+	fc = &__get_cpu_var(skb_free_cache);
+	fc->skbs[fc->count++] = skb;
+	if (unlikely(fc->count == SKB_FREE_BULK)) {
+		kmem_cache_free_bulk(skbuff_head_cache, SKB_FREE_BULK,
+				     fc->skbs);
+		fc->count = 0;
+	}
+}
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
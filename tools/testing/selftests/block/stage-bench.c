@@ -0,0 +1,259 @@
+/*
+ * stage-bench: throughput of small direct writes to adjacent blocks
+ * from several threads, and how many of them the block layer merges.
+ *
+ * Thread t of n writes blocks t, t + n, t + 2n... of the region in a
+ * loop with O_DIRECT, so neighbouring blocks always come from different
+ * threads and can only be merged by the queue, not by a task's plug.
+ * The writes per second, the requests the device completed and merged
+ * according to its stat file, and the stage_stats counters of the queue
+ * are reported.  Run it with -w 0 and with a staging window, e.g.
+ * -w 200, to compare.
+ *
+ * The path is a regular file on the device to test, extended to the
+ * region size if needed, or a block device.
+ * WARNING: the data on a block device given here is overwritten.
+ *
+ * Usage: stage-bench [-t threads] [-s seconds] [-b KB] [-m MB] [-w us]
+ *		      path
+ *	8 threads write 4KB blocks over 64MB for 5 seconds by default,
+ *	with the queue's current staging window unless -w sets another
+ *	one for the run
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <linux/fs.h>
+
+static volatile int stop;
+static int fd, nr_threads = 8;
+static unsigned long block = 4096, nr_blocks;
+
+struct bench_thread {
+	pthread_t thread;
+	int nr;
+	unsigned long ops;
+};
+
+static void *bench_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	unsigned long i = bt->nr;
+	void *buf;
+
+	if (posix_memalign(&buf, 4096, block)) {
+		perror("posix_memalign");
+		exit(1);
+	}
+	memset(buf, bt->nr, block);
+
+	while (!stop) {
+		if (pwrite(fd, buf, block, (off_t)i * block) != (ssize_t)block) {
+			perror("pwrite");
+			exit(1);
+		}
+		bt->ops++;
+		i += nr_threads;
+		if (i >= nr_blocks)
+			i = bt->nr;
+	}
+	free(buf);
+	return NULL;
+}
+
+/* Find the sysfs directory of the device holding @path */
+static int sysfs_dir(const char *path, char *dir, size_t len)
+{
+	char queue[PATH_MAX];
+	struct stat st;
+	dev_t dev;
+
+	if (stat(path, &st))
+		return -1;
+	dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+	snprintf(dir, len, "/sys/dev/block/%u:%u", major(dev), minor(dev));
+	snprintf(queue, sizeof(queue), "%s/queue", dir);
+	return access(queue, F_OK) && access(dir, F_OK);
+}
+
+/* The queue attribute @name of @dir, which may be a partition */
+static void queue_attr(const char *dir, const char *name, char *path,
+		       size_t len)
+{
+	snprintf(path, len, "%s/queue/%s", dir, name);
+	if (access(path, F_OK))
+		snprintf(path, len, "%s/../queue/%s", dir, name);
+}
+
+static int read_ulongs(const char *path, unsigned long *val, int nr)
+{
+	FILE *f = fopen(path, "r");
+	int i;
+
+	if (!f)
+		return -1;
+	for (i = 0; i < nr; i++)
+		if (fscanf(f, "%lu", &val[i]) != 1)
+			break;
+	fclose(f);
+	return i == nr ? 0 : -1;
+}
+
+static int write_ulong(const char *path, unsigned long val)
+{
+	FILE *f = fopen(path, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%lu\n", val) < 0;
+	return fclose(f) || ret ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long mb = 64, total = 0, old_window = 0, window;
+	unsigned long stat_before[6] = { 0 }, stat_after[6] = { 0 };
+	unsigned long stage_before[3] = { 0 }, stage_after[3] = { 0 };
+	int seconds = 5, set_window = 0, have_stage, i, opt;
+	char dir[64], stat_path[PATH_MAX];
+	char window_path[PATH_MAX], stage_path[PATH_MAX];
+	struct bench_thread *threads;
+	unsigned long long size;
+	struct stat st;
+
+	while ((opt = getopt(argc, argv, "t:s:b:m:w:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			block = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'm':
+			mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			window = strtoul(optarg, NULL, 0);
+			set_window = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1)
+		goto usage;
+	if (nr_threads < 1 || seconds < 1 || !block || block % 4096) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	fd = open(argv[optind], O_RDWR | O_CREAT | O_DIRECT, 0644);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	size = (unsigned long long)mb << 20;
+	if (S_ISBLK(st.st_mode)) {
+		unsigned long long dev_size;
+
+		if (ioctl(fd, BLKGETSIZE64, &dev_size)) {
+			perror("BLKGETSIZE64");
+			return 1;
+		}
+		if (size > dev_size)
+			size = dev_size;
+	} else if ((unsigned long long)st.st_size < size &&
+		   ftruncate(fd, size)) {
+		perror("ftruncate");
+		return 1;
+	}
+	nr_blocks = size / block;
+	if (nr_blocks < (unsigned long)nr_threads) {
+		fprintf(stderr, "region too small\n");
+		return 1;
+	}
+
+	if (sysfs_dir(argv[optind], dir, sizeof(dir))) {
+		fprintf(stderr, "no sysfs directory for %s\n", argv[optind]);
+		return 1;
+	}
+	snprintf(stat_path, sizeof(stat_path), "%s/stat", dir);
+	queue_attr(dir, "stage_window_us", window_path, sizeof(window_path));
+	queue_attr(dir, "stage_stats", stage_path, sizeof(stage_path));
+
+	have_stage = !read_ulongs(window_path, &old_window, 1);
+	if (set_window) {
+		if (!have_stage || write_ulong(window_path, window)) {
+			perror(window_path);
+			return 1;
+		}
+	} else {
+		window = old_window;
+	}
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+
+	read_ulongs(stat_path, stat_before, 6);
+	if (have_stage)
+		read_ulongs(stage_path, stage_before, 3);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].nr = i;
+		if (pthread_create(&threads[i].thread, NULL, bench_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		total += threads[i].ops;
+	}
+	read_ulongs(stat_path, stat_after, 6);
+	if (have_stage)
+		read_ulongs(stage_path, stage_after, 3);
+	if (set_window)
+		write_ulong(window_path, old_window);
+
+	printf("threads: %d, block: %luKB, region: %lluMB, window: %luus\n",
+	       nr_threads, block >> 10, size >> 20, have_stage ? window : 0);
+	printf("writes/sec: %lu (%.1f MB/s)\n", total / seconds,
+	       (double)total * block / seconds / (1 << 20));
+	/* fields 5 and 6 of the stat file: writes completed and merged */
+	printf("device writes: %lu, merged: %lu\n",
+	       stat_after[4] - stat_before[4], stat_after[5] - stat_before[5]);
+	if (have_stage)
+		printf("stage_stats: %lu staged, %lu expired, %lu merges\n",
+		       stage_after[0] - stage_before[0],
+		       stage_after[1] - stage_before[1],
+		       stage_after[2] - stage_before[2]);
+
+	free(threads);
+	close(fd);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-s seconds] [-b KB] [-m MB] "
+		"[-w us] path\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,191 @@
+/*
+ * stat-bench: stat() throughput of threads looking up paths under the
+ * same directories.
+ *
+ * A tree of nested directories is created under the given directory,
+ * and every thread stat()s the same paths in it in a loop: the deepest
+ * directory and a file in each level by default, or only the deepest
+ * directory with -1.  Each lookup takes and drops a reference on the
+ * dentries it ends on, so all the threads update the same dentry
+ * reference counts.  Compare the stats per second of a kernel with
+ * CONFIG_CMPXCHG_LOCKREF, where these updates are a cmpxchg of the
+ * count, and of one without it, e.g. with CONFIG_PARAVIRT_SPINLOCKS or
+ * CONFIG_DEBUG_SPINLOCK set, where each of them takes the dentry lock.
+ *
+ * Usage: stat-bench [-t threads] [-s seconds] [-D depth] [-d dir] [-1]
+ *	the tree is 4 levels deep under /tmp by default, and there are
+ *	as many threads as online cpus
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define LEVEL_NAME	"d"
+#define FILE_NAME	"f"
+
+static volatile int stop;
+static char **paths;
+static int nr_paths;
+
+struct bench_thread {
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static void *bench_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct stat st;
+	int i;
+
+	while (!stop) {
+		for (i = 0; i < nr_paths; i++) {
+			if (stat(paths[i], &st)) {
+				perror(paths[i]);
+				exit(1);
+			}
+		}
+		bt->ops += nr_paths;
+	}
+	return NULL;
+}
+
+/* Create @depth nested directories under @top, with a file in each */
+static int make_tree(const char *top, int depth, int dir_only)
+{
+	char path[PATH_MAX], file[PATH_MAX];
+	int i, fd;
+
+	paths = calloc(depth + 1, sizeof(*paths));
+	if (!paths)
+		return -1;
+
+	snprintf(path, sizeof(path), "%s", top);
+	for (i = 0; i < depth; i++) {
+		if (strlen(path) + sizeof("/" LEVEL_NAME "/" FILE_NAME) >
+		    sizeof(path)) {
+			fprintf(stderr, "tree too deep\n");
+			return -1;
+		}
+		strcat(path, "/" LEVEL_NAME);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			return -1;
+		}
+		strcpy(file, path);
+		strcat(file, "/" FILE_NAME);
+		fd = open(file, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0) {
+			perror(file);
+			return -1;
+		}
+		close(fd);
+		if (!dir_only)
+			paths[nr_paths++] = strdup(file);
+	}
+	paths[nr_paths++] = strdup(path);
+	return 0;
+}
+
+static void remove_tree(const char *top, int depth)
+{
+	char path[PATH_MAX], file[PATH_MAX];
+	int i, j;
+
+	for (i = depth; i > 0; i--) {
+		snprintf(path, sizeof(path), "%s", top);
+		for (j = 0; j < i; j++)
+			strcat(path, "/" LEVEL_NAME);
+		strcpy(file, path);
+		strcat(file, "/" FILE_NAME);
+		unlink(file);
+		rmdir(path);
+	}
+	rmdir(top);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = sysconf(_SC_NPROCESSORS_ONLN), seconds = 5;
+	int depth = 4, dir_only = 0, ret = 1;
+	const char *dir = "/tmp";
+	char top[PATH_MAX];
+	unsigned long total = 0;
+	struct bench_thread *threads;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:s:D:d:1")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'D':
+			depth = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case '1':
+			dir_only = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds] "
+				"[-D depth] [-d dir] [-1]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || depth < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	snprintf(top, sizeof(top), "%s/stat-bench.XXXXXX", dir);
+	if (!mkdtemp(top)) {
+		perror(top);
+		return 1;
+	}
+	if (make_tree(top, depth, dir_only))
+		goto out;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		goto out;
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i].thread, NULL, bench_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		total += threads[i].ops;
+	}
+
+	printf("threads: %d, depth: %d, paths: %d\n", nr_threads, depth,
+	       nr_paths);
+	printf("stats/sec: %lu (%lu per thread)\n", total / seconds,
+	       total / seconds / nr_threads);
+
+	free(threads);
+	ret = 0;
+out:
+	remove_tree(top, depth);
+	for (i = 0; i < nr_paths; i++)
+		free(paths[i]);
+	free(paths);
+	return ret;
+}
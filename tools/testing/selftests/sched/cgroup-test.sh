@@ -0,0 +1,161 @@
+#!/bin/bash
+#
+# cgroup-test: check how cpu time is shared between task groups, and
+# time hackbench runs in several groups at once.
+#
+# Two groups with cpu.shares 1024 and 2048 each run one cpu hog per
+# cpu; the second group must get about two thirds of the cpu time.
+# Then "perf bench sched messaging" (or hackbench) runs in each of a
+# few groups at the same time, and the time of each run is shown, to be
+# compared between kernels.
+#
+# Usage: cgroup-test.sh [seconds] [groups]
+#	the hogs run for 5 seconds and the messaging runs in 4 groups
+#	by default
+#
+
+SECONDS_RUN=${1:-5}
+NR_GROUPS=${2:-4}
+TOLERANCE=10	# percent
+CGROUP=
+MOUNTED=
+PIDS=
+
+prerequisite()
+{
+	msg="skip all tests:"
+
+	if [ $UID != 0 ]; then
+		echo $msg must be run as root >&2
+		exit 0
+	fi
+
+	CGROUP=`awk '$3 == "cgroup" && $4 ~ /(^|,)cpu(,|$)/ { print $2 }' \
+		/proc/mounts | head -1`
+	if [ -z "$CGROUP" ]; then
+		CGROUP=`mktemp -d /tmp/cgroup-test.XXXXXX`
+		if ! mount -t cgroup -o cpu none $CGROUP 2>/dev/null; then
+			rmdir $CGROUP
+			echo $msg no cpu cgroup controller >&2
+			exit 0
+		fi
+		MOUNTED=1
+	fi
+	CGROUP=$CGROUP/cgroup-test.$$
+	mkdir $CGROUP || exit 1
+}
+
+cleanup()
+{
+	[ -n "$PIDS" ] && kill $PIDS 2>/dev/null
+	wait 2>/dev/null
+	for group in $CGROUP/*/; do
+		[ -d "$group" ] && rmdir $group
+	done
+	rmdir $CGROUP
+	if [ -n "$MOUNTED" ]; then
+		umount ${CGROUP%/*}
+		rmdir ${CGROUP%/*}
+	fi
+}
+
+# user plus system time of a task, in clock ticks
+cpu_ticks()
+{
+	awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+# start a cpu hog in group $1, its pid is added to PIDS
+start_hog()
+{
+	(echo $BASHPID > $1/tasks; while :; do :; done) &
+	PIDS="$PIDS $!"
+}
+
+share_test()
+{
+	local nr_cpus=`getconf _NPROCESSORS_ONLN`
+	local low=$CGROUP/low high=$CGROUP/high
+	local low_pids high_pids pid i
+	local low_ticks=0 high_ticks=0 share
+
+	mkdir $low $high
+	echo 1024 > $low/cpu.shares
+	echo 2048 > $high/cpu.shares
+
+	for i in `seq $nr_cpus`; do
+		start_hog $low
+		low_pids="$low_pids $!"
+		start_hog $high
+		high_pids="$high_pids $!"
+	done
+
+	# let the load averages settle before measuring
+	sleep 1
+	for pid in $low_pids; do
+		low_ticks=$((low_ticks - `cpu_ticks $pid`))
+	done
+	for pid in $high_pids; do
+		high_ticks=$((high_ticks - `cpu_ticks $pid`))
+	done
+	sleep $SECONDS_RUN
+	for pid in $low_pids; do
+		low_ticks=$((low_ticks + `cpu_ticks $pid`))
+	done
+	for pid in $high_pids; do
+		high_ticks=$((high_ticks + `cpu_ticks $pid`))
+	done
+
+	kill $PIDS
+	wait 2>/dev/null
+	PIDS=
+	rmdir $low $high
+
+	if [ $((low_ticks + high_ticks)) -eq 0 ]; then
+		echo "no cpu time measured"
+		return 1
+	fi
+	share=$((high_ticks * 100 / (low_ticks + high_ticks)))
+	echo "shares 1024:2048, $nr_cpus hogs each: ${share}% of the" \
+	     "cpu time for the 2048 group, 66% expected"
+	[ $share -ge $((66 - TOLERANCE)) ] && [ $share -le $((66 + TOLERANCE)) ]
+}
+
+messaging_test()
+{
+	local cmd i
+
+	if perf bench sched messaging -l 1 > /dev/null 2>&1; then
+		cmd="perf bench sched messaging -g 10 -l 1000"
+	elif hackbench 1 > /dev/null 2>&1; then
+		cmd="hackbench 10 process 1000"
+	else
+		echo "no perf or hackbench, skipping the messaging runs"
+		return 0
+	fi
+
+	echo "$cmd in $NR_GROUPS groups at once:"
+	for i in `seq $NR_GROUPS`; do
+		mkdir $CGROUP/bench$i
+		(echo $BASHPID > $CGROUP/bench$i/tasks
+		 TIMEFORMAT="group $i: %R s elapsed"
+		 time $cmd > /dev/null) &
+	done
+	wait
+	for i in `seq $NR_GROUPS`; do
+		rmdir $CGROUP/bench$i
+	done
+}
+
+prerequisite
+trap cleanup EXIT
+
+share_test
+ret=$?
+if [ $ret -ne 0 ]; then
+	echo "[FAIL]"
+else
+	echo "[PASS]"
+fi
+messaging_test
+exit $ret
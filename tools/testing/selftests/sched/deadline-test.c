@@ -0,0 +1,307 @@
+/*
+ * deadline-test: run periodic SCHED_DEADLINE threads on one cpu and
+ * count the jobs that finish after their deadline.
+ *
+ * Each thread executes a job of -w us of cpu time every period and
+ * calls sched_yield() when done, which ends the job: the thread is
+ * throttled until the start of its next period.  With -o, one more
+ * thread reserves the same bandwidth but never yields, and the others
+ * must not miss any deadline because of it.
+ *
+ * Before starting, the test checks that admission control refuses a
+ * reservation of a whole cpu (unless RT throttling is disabled).
+ *
+ * Usage: deadline-test [-t threads] [-r runtime] [-d deadline]
+ *			[-p period] [-w work] [-s seconds] [-c cpu] [-o]
+ *	times are in microseconds; the deadline defaults to the period
+ *
+ * Needs CAP_SYS_NICE.  Returns 1 if a well-behaved thread missed a
+ * deadline or a check failed.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE		6
+#endif
+
+#ifndef __NR_sched_setattr
+#if defined(__x86_64__)
+#define __NR_sched_setattr	314
+#elif defined(__i386__)
+#define __NR_sched_setattr	351
+#else
+#error "sched_setattr() is not wired up on this architecture"
+#endif
+#endif
+
+struct sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+static int sched_setattr(pid_t pid, const struct sched_attr *attr,
+			 unsigned int flags)
+{
+	return syscall(__NR_sched_setattr, pid, attr, flags);
+}
+
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+static volatile int stop;
+static uint64_t runtime_us = 10000, deadline_us, period_us = 100000;
+static uint64_t work_us;
+static int cpu;
+
+struct dl_thread {
+	pthread_t thread;
+	int overrun;
+	int err;
+	unsigned long jobs, misses;
+	uint64_t max_late;
+};
+
+static uint64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* spin until this thread consumed @ns of cpu time */
+static void burn(uint64_t ns)
+{
+	uint64_t end = now_ns(CLOCK_THREAD_CPUTIME_ID) + ns;
+
+	while (!stop && now_ns(CLOCK_THREAD_CPUTIME_ID) < end)
+		;
+}
+
+static int become_deadline(void)
+{
+	struct sched_attr attr;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		return errno;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_runtime = runtime_us * NSEC_PER_USEC;
+	attr.sched_deadline = deadline_us * NSEC_PER_USEC;
+	attr.sched_period = period_us * NSEC_PER_USEC;
+
+	if (sched_setattr(0, &attr, 0))
+		return errno;
+	return 0;
+}
+
+static void *dl_fn(void *arg)
+{
+	struct dl_thread *dt = arg;
+	uint64_t period = period_us * NSEC_PER_USEC;
+	uint64_t deadline = deadline_us * NSEC_PER_USEC;
+	uint64_t release, end;
+
+	dt->err = become_deadline();
+	if (dt->err)
+		return NULL;
+
+	if (dt->overrun) {
+		while (!stop)
+			burn(NSEC_PER_SEC / 1000);
+		return NULL;
+	}
+
+	release = now_ns(CLOCK_MONOTONIC);
+	while (!stop) {
+		burn(work_us * NSEC_PER_USEC);
+		end = now_ns(CLOCK_MONOTONIC);
+
+		dt->jobs++;
+		if (end > release + deadline) {
+			dt->misses++;
+			if (end - (release + deadline) > dt->max_late)
+				dt->max_late = end - (release + deadline);
+		}
+
+		/* the job is done: sleep until the next period */
+		sched_yield();
+
+		/*
+		 * The next job is released one period later, unless
+		 * we were held back for more than a whole period.
+		 */
+		release += period;
+		end = now_ns(CLOCK_MONOTONIC);
+		if (end >= release + period)
+			release = end;
+	}
+	return NULL;
+}
+
+/*
+ * A reservation of a whole cpu must not be admitted while RT
+ * throttling keeps part of each period for the other tasks.
+ */
+static int check_admission(void)
+{
+	struct sched_attr attr;
+	long rt_runtime = -1;
+	FILE *f;
+	int ret;
+
+	f = fopen("/proc/sys/kernel/sched_rt_runtime_us", "r");
+	if (f) {
+		if (fscanf(f, "%ld", &rt_runtime) != 1)
+			rt_runtime = -1;
+		fclose(f);
+	}
+	if (rt_runtime < 0) {
+		printf("admission control: skipped, RT throttling disabled\n");
+		return 0;
+	}
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_runtime = 10000 * NSEC_PER_USEC;
+	attr.sched_deadline = attr.sched_runtime;
+
+	ret = sched_setattr(0, &attr, 0);
+	if (!ret) {
+		/* back to SCHED_OTHER before starting the threads */
+		attr.sched_policy = SCHED_OTHER;
+		attr.sched_runtime = attr.sched_deadline = 0;
+		sched_setattr(0, &attr, 0);
+		printf("admission control: FAILED, 100%% reservation accepted\n");
+		return 1;
+	}
+	if (errno != EBUSY) {
+		printf("admission control: FAILED, %s\n", strerror(errno));
+		return 1;
+	}
+	printf("admission control: ok\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 3, seconds = 5, overrun = 0, ret = 0;
+	struct dl_thread *threads;
+	int i, n, opt;
+
+	while ((opt = getopt(argc, argv, "t:r:d:p:w:s:c:o")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'r':
+			runtime_us = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			deadline_us = strtoull(optarg, NULL, 0);
+			break;
+		case 'p':
+			period_us = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			work_us = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 'o':
+			overrun = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-r runtime] "
+				"[-d deadline] [-p period] [-w work] "
+				"[-s seconds] [-c cpu] [-o]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!deadline_us)
+		deadline_us = period_us;
+	if (!work_us)
+		work_us = runtime_us / 2;
+	if (nr_threads < 1 || seconds < 1 || !runtime_us ||
+	    runtime_us > deadline_us || deadline_us > period_us ||
+	    work_us > runtime_us) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	ret |= check_admission();
+
+	n = nr_threads + overrun;
+	threads = calloc(n, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+	if (overrun)
+		threads[nr_threads].overrun = 1;
+
+	for (i = 0; i < n; i++)
+		if (pthread_create(&threads[i].thread, NULL, dl_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+
+	sleep(seconds);
+	stop = 1;
+
+	printf("cpu %d: runtime %llu us, deadline %llu us, period %llu us, "
+	       "work %llu us\n", cpu, (unsigned long long)runtime_us,
+	       (unsigned long long)deadline_us,
+	       (unsigned long long)period_us, (unsigned long long)work_us);
+
+	for (i = 0; i < n; i++) {
+		struct dl_thread *dt = &threads[i];
+
+		pthread_join(dt->thread, NULL);
+		if (dt->err) {
+			printf("thread %d: sched_setattr: %s\n", i,
+			       strerror(dt->err));
+			ret = 1;
+			continue;
+		}
+		if (dt->overrun) {
+			printf("thread %d: overrunning\n", i);
+			continue;
+		}
+		printf("thread %d: %lu jobs, %lu missed, max lateness %llu us\n",
+		       i, dt->jobs, dt->misses,
+		       (unsigned long long)(dt->max_late / NSEC_PER_USEC));
+		if (dt->misses)
+			ret = 1;
+	}
+
+	free(threads);
+	return ret;
+}
@@ -0,0 +1,261 @@
+/*
+ * placement-test: check that on cpus of different power the tasks
+ * that need much cpu time run on the most powerful cpus.
+ *
+ * The power of each cpu is read from /sys/devices/system/cpu/cpuN/
+ * cpu_capacity.  Heavy threads spin all the time, light threads run
+ * for 1 ms every 20 ms.  Every millisecond of its run time each thread
+ * notes the cpu it is on, and the test reports the share of these
+ * samples taken on the most powerful cpus, for each kind of thread.
+ * The heavy threads are started on the least powerful cpus, so they
+ * have to be moved.
+ *
+ * Usage: placement-test [-H heavy] [-L light] [-s seconds] [-m min]
+ *	there are as many heavy threads as most powerful cpus and as many
+ *	light threads as other cpus by default, and the test fails if
+ *	the heavy threads spent less than min percent, 90 by default, of
+ *	their time on the most powerful cpus
+ *
+ * Compare with echo NO_CAPACITY_FIT > /sys/kernel/debug/sched_features,
+ * and see the wakeups that were moved with the sched_capacity_fit
+ * tracepoint.  On a system whose cpus all have the same power, there
+ * is nothing to test.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+
+#define NSEC_PER_MSEC	1000000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+#define LIGHT_RUN	(1 * NSEC_PER_MSEC)
+#define LIGHT_PERIOD	(20 * NSEC_PER_MSEC)
+#define WARMUP		1
+
+struct test_thread {
+	pthread_t thread;
+	int heavy;
+	unsigned long samples;
+	unsigned long big_samples;
+};
+
+static unsigned long *capacity;
+static unsigned long max_capacity;
+static int nr_cpus;
+static cpu_set_t little_cpus;
+static volatile int measuring, stop;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Return the number of most powerful cpus, 0 if they are all the same */
+static int read_capacities(void)
+{
+	unsigned long min_capacity = ~0UL;
+	char path[64];
+	int cpu, nr_big = 0;
+	FILE *f;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	capacity = calloc(nr_cpus, sizeof(*capacity));
+	if (!capacity)
+		return 0;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%lu", &capacity[cpu]) != 1)
+			capacity[cpu] = 0;
+		fclose(f);
+		if (!capacity[cpu])
+			continue;
+		if (capacity[cpu] > max_capacity)
+			max_capacity = capacity[cpu];
+		if (capacity[cpu] < min_capacity)
+			min_capacity = capacity[cpu];
+	}
+	if (!max_capacity || min_capacity == max_capacity)
+		return 0;
+
+	CPU_ZERO(&little_cpus);
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		printf("cpu%d: capacity %lu\n", cpu, capacity[cpu]);
+		if (capacity[cpu] == max_capacity)
+			nr_big++;
+		else if (capacity[cpu])
+			CPU_SET(cpu, &little_cpus);
+	}
+	return nr_big;
+}
+
+static void sample(struct test_thread *t)
+{
+	int cpu = sched_getcpu();
+
+	if (!measuring || cpu < 0 || cpu >= nr_cpus)
+		return;
+	t->samples++;
+	if (capacity[cpu] == max_capacity)
+		t->big_samples++;
+}
+
+/* Spin for @len ns, sampling the cpu every millisecond */
+static void run_for(struct test_thread *t, uint64_t len)
+{
+	uint64_t now, next, end;
+
+	now = now_ns();
+	end = now + len;
+	next = now;
+	while (!stop && now < end) {
+		if (now >= next) {
+			sample(t);
+			next = now + NSEC_PER_MSEC;
+		}
+		now = now_ns();
+	}
+}
+
+static void *thread_fn(void *arg)
+{
+	struct test_thread *t = arg;
+	struct timespec period = { 0, LIGHT_PERIOD - LIGHT_RUN };
+	cpu_set_t all;
+	int cpu;
+
+	/*
+	 * Start the heavy threads on the small cpus, then let the
+	 * scheduler place them.
+	 */
+	if (t->heavy) {
+		sched_setaffinity(0, sizeof(little_cpus), &little_cpus);
+		sched_yield();
+		CPU_ZERO(&all);
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			CPU_SET(cpu, &all);
+		sched_setaffinity(0, sizeof(all), &all);
+	}
+
+	while (!stop) {
+		if (t->heavy) {
+			run_for(t, NSEC_PER_SEC);
+		} else {
+			run_for(t, LIGHT_RUN);
+			nanosleep(&period, NULL);
+		}
+	}
+	return NULL;
+}
+
+static double share(struct test_thread *threads, int nr, int heavy)
+{
+	unsigned long samples = 0, big_samples = 0;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (threads[i].heavy != heavy)
+			continue;
+		samples += threads[i].samples;
+		big_samples += threads[i].big_samples;
+	}
+	return samples ? 100.0 * big_samples / samples : 0.0;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_heavy = -1, nr_light = -1, seconds = 5, min_share = 90;
+	struct test_thread *threads;
+	double heavy_share;
+	int i, nr, nr_big, opt;
+
+	while ((opt = getopt(argc, argv, "H:L:s:m:")) != -1) {
+		switch (opt) {
+		case 'H':
+			nr_heavy = atoi(optarg);
+			break;
+		case 'L':
+			nr_light = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			min_share = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-H heavy] [-L light] "
+				"[-s seconds] [-m min]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (seconds < 1 || min_share < 0 || min_share > 100) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	nr_big = read_capacities();
+	if (!nr_big) {
+		printf("all cpus have the same capacity, nothing to test\n");
+		return 0;
+	}
+	if (nr_heavy < 0)
+		nr_heavy = nr_big;
+	if (nr_light < 0)
+		nr_light = CPU_COUNT(&little_cpus);
+
+	nr = nr_heavy + nr_light;
+	threads = calloc(nr ? nr : 1, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < nr; i++) {
+		threads[i].heavy = i < nr_heavy;
+		if (pthread_create(&threads[i].thread, NULL, thread_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(WARMUP);
+	measuring = 1;
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	heavy_share = share(threads, nr, 1);
+	printf("%d most powerful cpus, %d heavy threads, %d light threads\n",
+	       nr_big, nr_heavy, nr_light);
+	if (nr_heavy)
+		printf("heavy threads: %.1f%% of the time on the most "
+		       "powerful cpus\n", heavy_share);
+	if (nr_light)
+		printf("light threads: %.1f%% of the time on the most "
+		       "powerful cpus\n", share(threads, nr, 0));
+
+	free(threads);
+	free(capacity);
+
+	if (nr_heavy && nr_heavy <= nr_big && heavy_share < min_share) {
+		printf("FAIL: heavy threads on the most powerful cpus less "
+		       "than %d%% of the time\n", min_share);
+		return 1;
+	}
+	return 0;
+}
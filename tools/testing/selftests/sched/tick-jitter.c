@@ -0,0 +1,239 @@
+/*
+ * tick-jitter: measure how often a busy task pinned to one cpu is
+ * interrupted, to show the effect of nohz_full= and rcu_nocbs=.
+ *
+ * The task spins reading CLOCK_MONOTONIC.  Any gap between two reads
+ * longer than the threshold is time taken from it by an interrupt or
+ * by another task.  The local timer interrupts of the cpu are counted
+ * from the "LOC:" line of /proc/interrupts when there is one.
+ *
+ * Usage: tick-jitter [-c cpu] [-s seconds] [-t threshold] [-m max]
+ *		      [-f files]
+ *	the cpu defaults to the last online one, the threshold is in ns,
+ *	and with -m the test fails if the cpu took more than max timer
+ *	interrupts per second
+ *
+ * Run it on a housekeeping cpu and on a nohz_full= cpu, with nothing
+ * else running there, to compare: the timer interrupts should drop
+ * from HZ to about one per second.
+ *
+ * With -f, every 10 ms the task opens and closes that many files, each
+ * close queueing an RCU callback on the cpu.  The time spent doing so
+ * is not counted, only the interruptions that follow, such as the
+ * RCU_SOFTIRQ invoking the callbacks.  Run it on a cpu listed in
+ * rcu_nocbs= and on one that is not to compare.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_MSEC	1000000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+#define BURST_PERIOD	(10 * NSEC_PER_MSEC)
+
+static const uint64_t bucket_limit[] = {
+	10 * NSEC_PER_USEC, 100 * NSEC_PER_USEC, 1000 * NSEC_PER_USEC,
+};
+#define NR_BUCKETS	(sizeof(bucket_limit) / sizeof(bucket_limit[0]) + 1)
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Return the number of local timer interrupts taken by @cpu so far,
+ * or -1 if /proc/interrupts does not tell.
+ */
+static long long timer_interrupts(int cpu)
+{
+	char line[8192], label[32];
+	long long count = -1;
+	int col = -1, n = 0;
+	char *p, *tok;
+	FILE *f;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return -1;
+
+	/* The header names the column of each online cpu */
+	if (!fgets(line, sizeof(line), f))
+		goto out;
+	snprintf(label, sizeof(label), "CPU%d", cpu);
+	for (tok = strtok(line, " \t\n"); tok; tok = strtok(NULL, " \t\n"), n++)
+		if (!strcmp(tok, label))
+			col = n;
+	if (col < 0)
+		goto out;
+
+	while (fgets(line, sizeof(line), f)) {
+		p = line + strspn(line, " ");
+		if (strncmp(p, "LOC:", 4))
+			continue;
+		p += 4;
+		for (n = 0; n <= col; n++)
+			count = strtoll(p, &p, 10);
+		break;
+	}
+out:
+	fclose(f);
+	return count;
+}
+
+static void show_boot_param(const char *param)
+{
+	char cmdline[4096], *p;
+	FILE *f;
+
+	f = fopen("/proc/cmdline", "r");
+	if (!f)
+		return;
+	if (fgets(cmdline, sizeof(cmdline), f)) {
+		p = strstr(cmdline, param);
+		if (p)
+			printf("booted with %.*s\n", (int)strcspn(p, " \n"), p);
+		else
+			printf("booted without %s\n", param);
+	}
+	fclose(f);
+}
+
+/* Each close() of the last reference to a file queues an RCU callback */
+static void rcu_burst(int files)
+{
+	int i, fd;
+
+	for (i = 0; i < files; i++) {
+		fd = open("/dev/null", O_RDONLY);
+		if (fd >= 0)
+			close(fd);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t threshold = 5 * NSEC_PER_USEC, max_gap = 0, stolen = 0;
+	unsigned long buckets[NR_BUCKETS] = { 0 };
+	uint64_t start, end, prev, now, gap, burst = 0;
+	long long loc_start, loc_end;
+	unsigned long hits = 0;
+	int cpu, seconds = 10, max_ticks = -1, files = 0;
+	double ticks = -1;
+	cpu_set_t set;
+	unsigned int i;
+	int opt;
+
+	cpu = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+	while ((opt = getopt(argc, argv, "c:s:t:m:f:")) != -1) {
+		switch (opt) {
+		case 'c':
+			cpu = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 't':
+			threshold = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			max_ticks = atoi(optarg);
+			break;
+		case 'f':
+			files = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-c cpu] [-s seconds] "
+				"[-t threshold] [-m max] [-f files]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (cpu < 0 || seconds < 1 || !threshold || files < 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		perror("sched_setaffinity");
+		return 1;
+	}
+
+	show_boot_param("nohz_full=");
+	show_boot_param("rcu_nocbs=");
+
+	loc_start = timer_interrupts(cpu);
+	start = prev = now_ns();
+	end = start + seconds * NSEC_PER_SEC;
+	do {
+		now = now_ns();
+		if (files && now >= burst) {
+			rcu_burst(files);
+			burst = now + BURST_PERIOD;
+			prev = now_ns();
+			continue;
+		}
+		gap = now - prev;
+		prev = now;
+		if (gap < threshold)
+			continue;
+
+		hits++;
+		stolen += gap;
+		if (gap > max_gap)
+			max_gap = gap;
+		for (i = 0; i < NR_BUCKETS - 1; i++)
+			if (gap < bucket_limit[i])
+				break;
+		buckets[i]++;
+	} while (now < end);
+	loc_end = timer_interrupts(cpu);
+
+	printf("cpu %d: %d s, threshold %llu ns", cpu, seconds,
+	       (unsigned long long)threshold);
+	if (files)
+		printf(", %d rcu callbacks every %llu ms", files,
+		       (unsigned long long)(BURST_PERIOD / NSEC_PER_MSEC));
+	printf("\n");
+	printf("interruptions: %lu (%.1f/s), max %llu us, stolen %.3f%%\n",
+	       hits, (double)hits / seconds,
+	       (unsigned long long)(max_gap / NSEC_PER_USEC),
+	       100.0 * stolen / (now - start));
+	printf("  < 10 us: %lu, < 100 us: %lu, < 1 ms: %lu, >= 1 ms: %lu\n",
+	       buckets[0], buckets[1], buckets[2], buckets[3]);
+
+	if (loc_start >= 0 && loc_end >= 0) {
+		ticks = (double)(loc_end - loc_start) / seconds;
+		printf("local timer interrupts: %lld (%.1f/s)\n",
+		       loc_end - loc_start, ticks);
+	} else {
+		printf("local timer interrupts: unknown\n");
+	}
+
+	if (max_ticks >= 0) {
+		if (ticks < 0) {
+			printf("cannot check -m without timer interrupt counts\n");
+			return 1;
+		}
+		if (ticks > max_ticks) {
+			printf("FAILED: more than %d timer interrupts per second\n",
+			       max_ticks);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * mmap-bench: mmap()/munmap() and page fault throughput of threads
+ * sharing one mm, and the context switches they cost.
+ *
+ * Each thread maps a small anonymous region, touches its pages and
+ * unmaps it, in a loop.  mmap() and munmap() take mmap_sem for writing
+ * and the page faults take it for reading, so the threads contend on
+ * it all the time.  Compare the operations per second and the voluntary
+ * context switches per operation with and without optimistic spinning
+ * on rwsems (CONFIG_RWSEM_SPIN_ON_OWNER, or echo NO_OWNER_SPIN into
+ * /sys/kernel/debug/sched_features).
+ *
+ * Usage: mmap-bench [-t threads] [-s seconds] [-p pages]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static volatile int stop;
+static long page_size;
+static int nr_pages = 4;
+
+struct bench_thread {
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static void *bench_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	size_t len = nr_pages * page_size;
+	char *p;
+	int i;
+
+	while (!stop) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (i = 0; i < nr_pages; i++)
+			p[i * page_size] = 1;
+		munmap(p, len);
+		bt->ops++;
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 4, seconds = 5;
+	unsigned long total = 0;
+	struct bench_thread *threads;
+	struct rusage before, after;
+	long csw;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:s:p:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			nr_pages = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds] "
+				"[-p pages]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || nr_pages < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+
+	getrusage(RUSAGE_SELF, &before);
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i].thread, NULL, bench_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		total += threads[i].ops;
+	}
+	getrusage(RUSAGE_SELF, &after);
+	csw = after.ru_nvcsw - before.ru_nvcsw;
+
+	printf("threads: %d, pages: %d\n", nr_threads, nr_pages);
+	printf("mmap+fault+munmap/sec: %lu\n", total / seconds);
+	printf("voluntary context switches: %ld (%.3f per op)\n", csw,
+	       total ? (double)csw / total : 0.0);
+
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * seqread-bench: cost of large sequential reads through the page cache.
+ *
+ * The file or block device is read from start to end with read() of
+ * the given size, after its cached pages have been dropped with
+ * POSIX_FADV_DONTNEED, so that every page is brought in by readahead.
+ * On a ram disk (modprobe brd, then read /dev/ram0) the device itself
+ * costs next to nothing, so the system time per gigabyte is mostly the
+ * page cache insertion, LRU add and copy of each page.  On tmpfs there
+ * is no readahead, which gives the cost of the copy alone.  Compare the
+ * system time per gigabyte and the throughput of two kernels.
+ *
+ * Usage: seqread-bench [-b KB] [-n passes] [-m MB] path
+ *	reads are 1MB by default, and the whole file or device is read
+ *	3 times unless -m limits the size read
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <linux/fs.h>
+
+#define NSEC_PER_SEC	1000000000ULL
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static uint64_t tv_ns(struct timeval *tv)
+{
+	return tv->tv_sec * NSEC_PER_SEC + tv->tv_usec * 1000ULL;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long block = 1024, passes = 3, mb = 0, pass;
+	uint64_t size, done, start, elapsed = 0, stime = 0;
+	struct rusage before, after;
+	struct stat st;
+	ssize_t ret;
+	char *buf;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "b:n:m:")) != -1) {
+		switch (opt) {
+		case 'b':
+			block = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			passes = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			mb = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || !block || !passes)
+		goto usage;
+	block <<= 10;
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, &size)) {
+			perror("BLKGETSIZE64");
+			return 1;
+		}
+	} else {
+		size = st.st_size;
+	}
+	if (mb && size > (uint64_t)mb << 20)
+		size = (uint64_t)mb << 20;
+	if (!size) {
+		fprintf(stderr, "%s is empty\n", argv[optind]);
+		return 1;
+	}
+
+	buf = malloc(block);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		if (posix_fadvise(fd, 0, size, POSIX_FADV_DONTNEED)) {
+			perror("posix_fadvise");
+			return 1;
+		}
+		if (lseek(fd, 0, SEEK_SET)) {
+			perror("lseek");
+			return 1;
+		}
+
+		getrusage(RUSAGE_SELF, &before);
+		start = now_ns();
+		for (done = 0; done < size; done += ret) {
+			ret = read(fd, buf, size - done < block ?
+				   size - done : block);
+			if (ret < 0) {
+				perror("read");
+				return 1;
+			}
+			if (!ret)
+				break;
+		}
+		elapsed += now_ns() - start;
+		getrusage(RUSAGE_SELF, &after);
+		stime += tv_ns(&after.ru_stime) - tv_ns(&before.ru_stime);
+		size = done;
+	}
+
+	printf("size: %lluMB, reads: %luKB, passes: %lu\n",
+	       (unsigned long long)size >> 20, block >> 10, passes);
+	printf("throughput: %.1f MB/s\n",
+	       (double)(size * passes >> 20) * NSEC_PER_SEC / elapsed);
+	printf("system time: %.1f ms per GB\n",
+	       (double)stime / 1000000 / ((double)(size * passes) / (1 << 30)));
+
+	free(buf);
+	close(fd);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-b KB] [-n passes] [-m MB] path\n",
+		argv[0]);
+	return 1;
+}
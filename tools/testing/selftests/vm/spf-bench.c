@@ -0,0 +1,174 @@
+/*
+ * spf-bench: page fault throughput of a multi-threaded process while
+ * another thread keeps calling mmap() and munmap().
+ *
+ * Each fault thread touches every page of its own anonymous region and
+ * then drops the pages with MADV_DONTNEED, over and over.  The churn
+ * thread maps and unmaps a small region in a loop, taking mmap_sem for
+ * writing each time.  Without speculative page faults the fault threads
+ * queue up behind it on mmap_sem.
+ *
+ * Usage: spf-bench [-t threads] [-s seconds] [-m region MB] [-n]
+ *	-n	run without the churn thread, for comparison
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifndef MADV_NOHUGEPAGE
+#define MADV_NOHUGEPAGE 15
+#endif
+
+static volatile int stop;
+static unsigned long region_size = 16UL << 20;
+static long page_size;
+
+struct fault_thread {
+	pthread_t thread;
+	unsigned long faults;
+};
+
+static void *fault_fn(void *arg)
+{
+	struct fault_thread *ft = arg;
+	unsigned long off;
+	char *p;
+
+	p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	/* keep the region mapped with small pages */
+	madvise(p, region_size, MADV_NOHUGEPAGE);
+
+	while (!stop) {
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			p[off] = 1;
+			ft->faults++;
+		}
+		madvise(p, region_size, MADV_DONTNEED);
+	}
+
+	munmap(p, region_size);
+	return NULL;
+}
+
+static void *churn_fn(void *arg)
+{
+	unsigned long *ops = arg;
+	size_t len = 16 * page_size;
+	char *p;
+
+	while (!stop) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		p[0] = 1;
+		munmap(p, len);
+		(*ops)++;
+	}
+	return NULL;
+}
+
+static unsigned long read_vmstat(const char *name)
+{
+	char key[64];
+	unsigned long val;
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &val) == 2) {
+		if (!strcmp(key, name)) {
+			fclose(f);
+			return val;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = 4, seconds = 5, churn = 1;
+	unsigned long total = 0, churn_ops = 0, spf_before, spf_after;
+	struct fault_thread *threads;
+	pthread_t churn_thread;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:s:m:n")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			region_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'n':
+			churn = 0;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds] "
+				"[-m region MB] [-n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_threads < 1 || seconds < 1 || !region_size) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads) {
+		perror("calloc");
+		return 1;
+	}
+
+	spf_before = read_vmstat("speculative_pgfault");
+
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i].thread, NULL, fault_fn,
+				   &threads[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	if (churn && pthread_create(&churn_thread, NULL, churn_fn,
+				    &churn_ops)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		total += threads[i].faults;
+	}
+	if (churn)
+		pthread_join(churn_thread, NULL);
+
+	spf_after = read_vmstat("speculative_pgfault");
+
+	printf("threads: %d, churn: %s\n", nr_threads, churn ? "on" : "off");
+	printf("faults/sec: %lu\n", total / seconds);
+	if (churn)
+		printf("mmap+munmap/sec: %lu\n", churn_ops / seconds);
+	printf("speculative faults: %lu\n", spf_after - spf_before);
+
+	free(threads);
+	return 0;
+}
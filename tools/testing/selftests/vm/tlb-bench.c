@@ -0,0 +1,191 @@
+/*
+ * tlb-bench: cost of random accesses to a large table, mapped with
+ * small pages, transparent huge pages or hugetlb pages.
+ *
+ * The table is one pointer chain running through all of its pages in
+ * a random order, so each access is to a different page and depends on
+ * the one before: with small pages nearly every access misses the TLB,
+ * with huge pages a 2MB (or 4MB) entry covers 512 (or 1024) of them.
+ * The average time per access is reported, together with how much of
+ * the table is backed by transparent huge pages according to
+ * /proc/self/smaps.
+ *
+ * Usage: tlb-bench [-m MB] [-n loops] [-t | -H]
+ *	the table is 256MB by default, and is mapped with small pages
+ *	unless -t asks for transparent huge pages (madvise MADV_HUGEPAGE,
+ *	see /sys/kernel/mm/transparent_hugepage/enabled) or -H for hugetlb
+ *	pages (MAP_HUGETLB, needs /proc/sys/vm/nr_hugepages)
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB	0x40000
+#endif
+
+#define HUGE_ALIGN	(4UL << 20)	/* covers 2MB and 4MB pages */
+#define CACHELINE	64
+#define NSEC_PER_SEC	1000000000ULL
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Return the AnonHugePages of the mapping at @addr in kB, -1 if unknown */
+static long anon_huge_kb(void *addr)
+{
+	char line[256], start[32];
+	long kb = -1;
+	int found = 0;
+	FILE *f;
+
+	f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		return -1;
+	snprintf(start, sizeof(start), "%lx-", (unsigned long)addr);
+	while (fgets(line, sizeof(line), f)) {
+		if (!found) {
+			found = !strncmp(line, start, strlen(start));
+			continue;
+		}
+		if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
+
+/*
+ * Link one cache line of each page into a chain visiting the pages in
+ * a random order, at a random line within the page so that the chain
+ * does not always hit the same cache sets.
+ */
+static void **build_chain(char *table, unsigned long nr_pages,
+			  long page_size)
+{
+	unsigned long *order, i, j, tmp;
+	void **first, **p;
+	unsigned long lines = page_size / CACHELINE;
+
+	if (!nr_pages)
+		return NULL;
+	order = malloc(nr_pages * sizeof(*order));
+	if (!order)
+		return NULL;
+	for (i = 0; i < nr_pages; i++)
+		order[i] = i;
+	for (i = nr_pages - 1; i > 0; i--) {
+		j = random() % (i + 1);
+		tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for (i = 0; i < nr_pages; i++)
+		order[i] = order[i] * page_size +
+			   (random() % lines) * CACHELINE;
+	first = (void **)(table + order[0]);
+	for (i = 0, p = first; i < nr_pages - 1; i++) {
+		*p = table + order[i + 1];
+		p = *p;
+	}
+	*p = first;
+
+	free(order);
+	return first;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long mb = 256, loops = 10, nr_pages, i, len, map_len;
+	int thp = 0, hugetlb = 0, opt, flags;
+	long page_size = sysconf(_SC_PAGESIZE), huge_kb;
+	uint64_t start, elapsed;
+	void **p, **first;
+	char *map, *table;
+
+	while ((opt = getopt(argc, argv, "m:n:tH")) != -1) {
+		switch (opt) {
+		case 'm':
+			mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			loops = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			thp = 1;
+			break;
+		case 'H':
+			hugetlb = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-m MB] [-n loops] "
+				"[-t | -H]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!mb || !loops || (thp && hugetlb)) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	/*
+	 * Align the table so that the huge pages cover all of it, the
+	 * hugetlb mappings are aligned already.
+	 */
+	len = mb << 20;
+	map_len = hugetlb ? len : len + HUGE_ALIGN;
+	flags = MAP_PRIVATE | MAP_ANONYMOUS | (hugetlb ? MAP_HUGETLB : 0);
+	map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	table = hugetlb ? map : (char *)(((unsigned long)map +
+					  HUGE_ALIGN - 1) & ~(HUGE_ALIGN - 1));
+	if (!hugetlb && madvise(table, len,
+				thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE)) {
+		perror("madvise");
+		return 1;
+	}
+
+	nr_pages = len / page_size;
+	first = build_chain(table, nr_pages, page_size);
+	if (!first) {
+		perror("malloc");
+		return 1;
+	}
+
+	/* one walk to fault the table in and warm the caches */
+	for (i = 0, p = first; i < nr_pages; i++)
+		p = *p;
+
+	start = now_ns();
+	for (i = 0; i < loops * nr_pages; i++)
+		p = *p;
+	elapsed = now_ns() - start;
+
+	printf("table: %luMB, %s pages\n", mb,
+	       hugetlb ? "hugetlb" : thp ? "transparent huge" : "small");
+	huge_kb = anon_huge_kb(table);
+	if (huge_kb >= 0)
+		printf("transparent huge pages: %ldMB\n", huge_kb >> 10);
+	printf("accesses: %lu, %.1f ns per access\n", loops * nr_pages,
+	       (double)elapsed / (loops * nr_pages));
+
+	/* keep the chase from being optimised out */
+	if (!p)
+		return 1;
+	munmap(map, map_len);
+	return 0;
+}
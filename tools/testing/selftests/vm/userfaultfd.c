@@ -0,0 +1,272 @@
+/*
+ * userfaultfd: register an anonymous range in a userfaultfd, take a
+ * missing fault on it from a second thread, resolve the fault with
+ * UFFDIO_COPY and wake the thread with UFFDIO_WAKE.
+ *
+ * The faulting thread reads every page of the range, the main thread
+ * reads the fault messages and fills each page with a pattern of its
+ * own, copying with UFFDIO_COPY_MODE_DONTWAKE and waking the thread
+ * separately.  The test fails if a fault is reported at a wrong
+ * address, if the thread does not finish, or if it read data other
+ * than what was copied.  The range is then unregistered and a tmpfs
+ * mapping is checked to be refused, as only anonymous memory can be
+ * registered.
+ *
+ * Usage: userfaultfd [pages]
+ *	the range is 16 pages by default
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../../../../include/linux/userfaultfd.h"
+
+/* The numbers of this tree's syscall tables, not of the libc headers */
+#if defined(__x86_64__)
+#define NR_userfaultfd	313
+#elif defined(__i386__)
+#define NR_userfaultfd	350
+#else
+#error "userfaultfd is not wired up on this architecture"
+#endif
+
+#define POLL_TIMEOUT	5000	/* ms */
+
+static unsigned long page_size;
+static unsigned long nr_pages = 16;
+static char *area;
+static volatile int done;
+static int bad_data;
+
+static void fill(char *p, unsigned long nr)
+{
+	memset(p, (int)(nr & 0x7f) + 1, page_size);
+}
+
+static void *fault_thread(void *arg)
+{
+	unsigned long nr;
+	char *p;
+
+	(void)arg;
+	for (nr = 0; nr < nr_pages; nr++) {
+		p = area + nr * page_size;
+		/* the first byte faults, the whole page must match */
+		if (p[0] != (char)((nr & 0x7f) + 1) ||
+		    p[page_size - 1] != p[0])
+			bad_data = 1;
+	}
+	done = 1;
+	return NULL;
+}
+
+static int resolve_fault(int uffd, char *src, unsigned long *copied)
+{
+	struct uffdio_copy copy;
+	struct uffdio_range range;
+	struct uffd_msg msg;
+	struct pollfd pfd = { .fd = uffd, .events = POLLIN };
+	unsigned long addr, nr;
+	int ret;
+
+	ret = poll(&pfd, 1, POLL_TIMEOUT);
+	if (ret <= 0) {
+		fprintf(stderr, "no fault reported%s\n",
+			ret ? "" : " within the timeout");
+		return -1;
+	}
+	if (read(uffd, &msg, sizeof(msg)) != sizeof(msg)) {
+		perror("read");
+		return -1;
+	}
+	if (msg.event != UFFD_EVENT_PAGEFAULT) {
+		fprintf(stderr, "unexpected event %u\n", msg.event);
+		return -1;
+	}
+
+	addr = msg.arg.pagefault.address & ~(page_size - 1);
+	if (addr < (unsigned long)area ||
+	    addr >= (unsigned long)area + nr_pages * page_size) {
+		fprintf(stderr, "fault at %#lx outside the range\n", addr);
+		return -1;
+	}
+	nr = (addr - (unsigned long)area) / page_size;
+	if (nr != *copied) {
+		fprintf(stderr, "fault on page %lu, expected %lu\n",
+			nr, *copied);
+		return -1;
+	}
+
+	fill(src, nr);
+	copy.dst = addr;
+	copy.src = (unsigned long)src;
+	copy.len = page_size;
+	copy.mode = UFFDIO_COPY_MODE_DONTWAKE;
+	copy.copy = 0;
+	if (ioctl(uffd, UFFDIO_COPY, &copy)) {
+		perror("UFFDIO_COPY");
+		return -1;
+	}
+	if (copy.copy != (long long)page_size) {
+		fprintf(stderr, "UFFDIO_COPY copied %lld bytes\n",
+			(long long)copy.copy);
+		return -1;
+	}
+
+	range.start = addr;
+	range.len = page_size;
+	if (ioctl(uffd, UFFDIO_WAKE, &range)) {
+		perror("UFFDIO_WAKE");
+		return -1;
+	}
+	(*copied)++;
+	return 0;
+}
+
+/* Registering a tmpfs mapping must fail with EINVAL */
+static int check_tmpfs_refused(int uffd)
+{
+	struct uffdio_register reg;
+	char path[] = "/dev/shm/userfaultfd-XXXXXX";
+	void *shm;
+	int fd, ret = 0;
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		printf("no /dev/shm, skipping the tmpfs check\n");
+		return 0;
+	}
+	unlink(path);
+	if (ftruncate(fd, page_size)) {
+		perror("ftruncate");
+		close(fd);
+		return -1;
+	}
+	shm = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	reg.range.start = (unsigned long)shm;
+	reg.range.len = page_size;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (!ioctl(uffd, UFFDIO_REGISTER, &reg) || errno != EINVAL) {
+		fprintf(stderr, "tmpfs mapping registered\n");
+		ret = -1;
+	}
+	munmap(shm, page_size);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct uffdio_api api;
+	struct uffdio_register reg;
+	struct uffdio_range range;
+	unsigned long copied = 0;
+	pthread_t thread;
+	char *src;
+	int uffd, ret = 1;
+
+	if (argc > 1)
+		nr_pages = strtoul(argv[1], NULL, 0);
+	if (!nr_pages) {
+		fprintf(stderr, "usage: %s [pages]\n", argv[0]);
+		return 1;
+	}
+	page_size = sysconf(_SC_PAGESIZE);
+
+	uffd = syscall(NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (uffd < 0) {
+		if (errno == ENOSYS) {
+			printf("userfaultfd not supported, skipping\n");
+			return 0;
+		}
+		perror("userfaultfd");
+		return 1;
+	}
+
+	api.api = UFFD_API;
+	api.features = 0;
+	if (ioctl(uffd, UFFDIO_API, &api)) {
+		perror("UFFDIO_API");
+		return 1;
+	}
+	if (!(api.ioctls & (1ULL << _UFFDIO_REGISTER))) {
+		fprintf(stderr, "UFFDIO_REGISTER not available\n");
+		return 1;
+	}
+
+	area = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	src = malloc(page_size);
+	if (area == MAP_FAILED || !src) {
+		perror("mmap");
+		return 1;
+	}
+
+	reg.range.start = (unsigned long)area;
+	reg.range.len = nr_pages * page_size;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(uffd, UFFDIO_REGISTER, &reg)) {
+		perror("UFFDIO_REGISTER");
+		return 1;
+	}
+	if (!(reg.ioctls & (1ULL << _UFFDIO_COPY)) ||
+	    !(reg.ioctls & (1ULL << _UFFDIO_WAKE))) {
+		fprintf(stderr, "UFFDIO_COPY or UFFDIO_WAKE not available\n");
+		return 1;
+	}
+
+	if (pthread_create(&thread, NULL, fault_thread, NULL)) {
+		perror("pthread_create");
+		return 1;
+	}
+	while (copied < nr_pages)
+		if (resolve_fault(uffd, src, &copied))
+			goto out;
+	/*
+	 * Every page is filled now, so the thread does not fault any
+	 * more and finishes on its own.
+	 */
+	pthread_join(thread, NULL);
+	if (!done || bad_data) {
+		fprintf(stderr, "the faulting thread read wrong data\n");
+		goto out;
+	}
+
+	range.start = (unsigned long)area;
+	range.len = nr_pages * page_size;
+	if (ioctl(uffd, UFFDIO_UNREGISTER, &range)) {
+		perror("UFFDIO_UNREGISTER");
+		goto out;
+	}
+	if (check_tmpfs_refused(uffd))
+		goto out;
+
+	printf("%lu faults resolved with UFFDIO_COPY and UFFDIO_WAKE\n",
+	       copied);
+	ret = 0;
+out:
+	/*
+	 * On failure the thread may still be blocked in a fault; closing
+	 * the userfaultfd wakes it and lets the kernel fill the page.
+	 */
+	close(uffd);
+	if (ret)
+		pthread_join(thread, NULL);
+	munmap(area, nr_pages * page_size);
+	free(src);
+	return ret;
+}